@@ -0,0 +1,140 @@
+#pragma once
+
+#include "matrix.hpp"
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  // Conversion to blocked CSR (see BCSRMatrix), and the choice of the
+  // block size in the style of OSKI: the fill ratio of each block size is
+  // estimated from a sample of the block rows. OSKI weighs the fill ratio
+  // with a register-blocking profile measured on the machine; instead,
+  // chooseBlockSize minimizes the estimated bytes read per element,
+  //   fillRatio * (sizeof(ValueType) + sizeof(IndexType) / (r * c)),
+  // since SpMV is bound by memory bandwidth.
+  class BCSR {
+  public:
+    static const unsigned int maxBlockSize = 8;
+
+    // Duplicate elements are summed into their block.
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<BCSRMatrix<ValueType, IndexType>> convert(const CSRMatrix<ValueType, IndexType> &csr,
+                                                                     unsigned int r, unsigned int c) {
+      checkBlockSize(r, c);
+      const unsigned int numBlockRows = (csr.N + r - 1) / r;
+      const unsigned int numBlockCols = (csr.M + c - 1) / c;
+      std::vector<long> lastBlockRow(numBlockCols, -1);
+
+      IndexType *blockRowPtr = new IndexType[numBlockRows + 1];
+      blockRowPtr[0] = 0;
+      long numBlocks = 0;
+      for (unsigned int blockRow = 0; blockRow < numBlockRows; blockRow++) {
+        numBlocks += forEachNewBlock(csr, r, c, blockRow, lastBlockRow, [](IndexType) { });
+        blockRowPtr[blockRow + 1] = numBlocks;
+      }
+      if (numBlocks * r * c > std::numeric_limits<IndexType>::max()) {
+        std::cerr << "The blocked matrix has too many values for " << sizeof(IndexType) * 8 << "-bit indices.\n";
+        exit(1);
+      }
+
+      const long blockSize = r * c;
+      IndexType *blockCols = new IndexType[numBlocks];
+      ValueType *vals = new ValueType[numBlocks * blockSize]();
+      std::vector<IndexType> blockPositions(numBlockCols);
+      std::fill(lastBlockRow.begin(), lastBlockRow.end(), -1);
+      for (unsigned int blockRow = 0; blockRow < numBlockRows; blockRow++) {
+        IndexType *rowBlockCols = blockCols + blockRowPtr[blockRow];
+        int count = 0;
+        forEachNewBlock(csr, r, c, blockRow, lastBlockRow, [&](IndexType blockCol) {
+          rowBlockCols[count++] = blockCol;
+        });
+        std::sort(rowBlockCols, rowBlockCols + count);
+        for (int k = 0; k < count; k++) {
+          blockPositions[rowBlockCols[k]] = blockRowPtr[blockRow] + k;
+        }
+
+        const unsigned int rowEnd = std::min(csr.N, (blockRow + 1) * r);
+        for (unsigned int row = blockRow * r; row < rowEnd; row++) {
+          for (IndexType k = csr.rowPtr[row]; k < csr.rowPtr[row + 1]; k++) {
+            const IndexType col = csr.colIndices[k];
+            const long position = blockPositions[col / c];
+            vals[position * blockSize + (row - blockRow * r) * c + col % c] += csr.values[k];
+          }
+        }
+      }
+
+      return std::make_unique<BCSRMatrix<ValueType, IndexType>>(blockRowPtr, blockCols, vals, csr.N, csr.M, csr.NZ,
+                                                                r, c, numBlocks);
+    }
+
+    // Estimates the fill ratio of r x c blocks from every k-th block row,
+    // where k is about 1 / sampleFraction.
+    template<typename ValueType, typename IndexType>
+    static double estimateFill(const CSRMatrix<ValueType, IndexType> &csr, unsigned int r, unsigned int c,
+                               double sampleFraction = 0.02) {
+      checkBlockSize(r, c);
+      const unsigned int numBlockRows = (csr.N + r - 1) / r;
+      const unsigned int stride = sampleFraction >= 1.0 ? 1 : (unsigned int)(1.0 / sampleFraction);
+      std::vector<long> lastBlockRow((csr.M + c - 1) / c, -1);
+      long numBlocks = 0;
+      long numElements = 0;
+      for (unsigned int blockRow = 0; blockRow < numBlockRows; blockRow += stride) {
+        numBlocks += forEachNewBlock(csr, r, c, blockRow, lastBlockRow, [](IndexType) { });
+        const unsigned int rowEnd = std::min(csr.N, (blockRow + 1) * r);
+        numElements += csr.rowPtr[rowEnd] - csr.rowPtr[blockRow * r];
+      }
+      return numElements == 0 ? 1.0 : (double)numBlocks * r * c / numElements;
+    }
+
+    // Returns the (r, c) in [1, maxBlockSize]^2 with the lowest estimated
+    // bytes per element; ties go to the smaller block.
+    template<typename ValueType, typename IndexType>
+    static std::pair<unsigned int, unsigned int> chooseBlockSize(const CSRMatrix<ValueType, IndexType> &csr,
+                                                                 double sampleFraction = 0.02) {
+      std::pair<unsigned int, unsigned int> best(1, 1);
+      double bestCost = 0;
+      for (unsigned int r = 1; r <= maxBlockSize; r++) {
+        for (unsigned int c = 1; c <= maxBlockSize; c++) {
+          double cost = estimateFill(csr, r, c, sampleFraction) *
+                        (sizeof(ValueType) + (double)sizeof(IndexType) / (r * c));
+          if ((r == 1 && c == 1) || cost < bestCost) {
+            best = std::make_pair(r, c);
+            bestCost = cost;
+          }
+        }
+      }
+      return best;
+    }
+
+  private:
+    static void checkBlockSize(unsigned int r, unsigned int c) {
+      if (r == 0 || c == 0) {
+        std::cerr << "Block dimensions must be at least 1.\n";
+        exit(1);
+      }
+    }
+
+    // Calls visit(blockCol) for each block of the block row that is not
+    // marked in lastBlockRow yet, marks it, and returns the number of such
+    // blocks. lastBlockRow must not have marks of this block row.
+    template<typename ValueType, typename IndexType, typename Visit>
+    static int forEachNewBlock(const CSRMatrix<ValueType, IndexType> &csr, unsigned int r, unsigned int c,
+                               unsigned int blockRow, std::vector<long> &lastBlockRow, Visit visit) {
+      const unsigned int rowEnd = std::min(csr.N, (blockRow + 1) * r);
+      int count = 0;
+      for (IndexType k = csr.rowPtr[blockRow * r]; k < csr.rowPtr[rowEnd]; k++) {
+        const IndexType blockCol = csr.colIndices[k] / c;
+        if (lastBlockRow[blockCol] != (long)blockRow) {
+          lastBlockRow[blockCol] = blockRow;
+          visit(blockCol);
+          count++;
+        }
+      }
+      return count;
+    }
+  };
+}
@@ -0,0 +1,192 @@
+#include <iostream>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <random>
+#include <vector>
+#include "matrix.hpp"
+#include "mmmatrix.hpp"
+#include "spmv.hpp"
+#include "transpose.hpp"
+#include "triangular.hpp"
+
+using namespace thundercat;
+using namespace std;
+
+bool __DEBUG__ = false;
+
+typedef std::chrono::steady_clock Clock;
+
+static double secondsSince(Clock::time_point start) {
+  return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+static std::unique_ptr<MMMatrix<double>> randomMatrix(unsigned int N, unsigned long NZ) {
+  auto matrix = std::make_unique<MMMatrix<double>>(N, N);
+  std::mt19937_64 generator(42);
+  std::uniform_int_distribution<int> index(0, N - 1);
+  std::uniform_real_distribution<double> value(-1.0, 1.0);
+  for (unsigned long i = 0; i < NZ; i++) {
+    matrix->add(index(generator), index(generator), value(generator));
+  }
+  return matrix;
+}
+
+static std::unique_ptr<MMMatrix<double>> copyOf(std::unique_ptr<MMMatrix<double>> const &mmMatrix) {
+  auto matrix = std::make_unique<MMMatrix<double>>(mmMatrix->N, mmMatrix->M);
+  for (auto elt : mmMatrix->getElementView()) {
+    matrix->add(elt.rowIndex, elt.colIndex, elt.value);
+  }
+  return matrix;
+}
+
+int main(int argc, const char *argv[]) {
+  // Usage: ./benchmarkConversions <matrixFilePath>
+  //        ./benchmarkConversions -random <numRows> <numNonzeros>
+  std::unique_ptr<MMMatrix<double>> mmMatrix;
+  if (argc == 4 && strcmp(argv[1], "-random") == 0) {
+    mmMatrix = randomMatrix(atoi(argv[2]), atol(argv[3]));
+  } else if (argc == 2) {
+    mmMatrix = MMMatrix<double>::fromFile(argv[1]);
+  } else {
+    cerr << "You must give me a .mtx filename, or -random <numRows> <numNonzeros>.\n";
+    exit(1);
+  }
+  printf("%u %u %zu\n", mmMatrix->N, mmMatrix->M, mmMatrix->numElements());
+
+  // Comparison sort, i.e. the conversions before counting sort was used.
+  for (auto compare : { MMElement<double>::compareRowMajor, MMElement<double>::compareColumnMajor }) {
+    auto elements = mmMatrix->getElements();
+    auto start = Clock::now();
+    std::sort(elements.begin(), elements.end(), compare);
+    printf("std::sort %s: %.3f s\n",
+           compare == MMElement<double>::compareRowMajor ? "row-major" : "column-major",
+           secondsSince(start));
+  }
+
+  {
+    auto matrix = copyOf(mmMatrix);
+    auto start = Clock::now();
+    matrix->sortRowMajor();
+    printf("counting sort row-major: %.3f s\n", secondsSince(start));
+  }
+  {
+    auto matrix = copyOf(mmMatrix);
+    auto start = Clock::now();
+    matrix->sortColumnMajor();
+    printf("counting sort column-major: %.3f s\n", secondsSince(start));
+  }
+  {
+    auto matrix = copyOf(mmMatrix);
+    auto start = Clock::now();
+    auto csrMatrix = matrix->toCSR();
+    printf("toCSR: %.3f s\n", secondsSince(start));
+  }
+  {
+    auto matrix = copyOf(mmMatrix);
+    auto start = Clock::now();
+    auto cscMatrix = matrix->toCSC();
+    printf("toCSC: %.3f s\n", secondsSince(start));
+  }
+  {
+    // The elements are left sorted, so the sorts are skipped or cut to
+    // one counting sort.
+    auto matrix = copyOf(mmMatrix);
+    matrix->toCSR();
+    auto start = Clock::now();
+    auto csrMatrix = matrix->toCSR();
+    printf("toCSR, row-major sorted: %.3f s\n", secondsSince(start));
+    start = Clock::now();
+    auto cscMatrix = matrix->toCSC();
+    printf("toCSC, row-major sorted: %.3f s\n", secondsSince(start));
+  }
+  {
+    auto csrMatrix = mmMatrix->toCSR();
+    auto start = Clock::now();
+    auto cscMatrix = Transpose::toCSC(*csrMatrix);
+    printf("Transpose::toCSC: %.3f s\n", secondsSince(start));
+    start = Clock::now();
+    auto transposed = Transpose::toCSR(*cscMatrix);
+    printf("Transpose::toCSR: %.3f s\n", secondsSince(start));
+  }
+  {
+    auto matrix = copyOf(mmMatrix);
+    auto start = Clock::now();
+    auto ldMatrix = matrix->getLD()->toCSR();
+    auto udMatrix = matrix->getUD()->toCSR();
+    printf("getLD/getUD + toCSR: %.3f s\n", secondsSince(start));
+    auto csrMatrix = matrix->toCSR();
+    start = Clock::now();
+    LDU<double> ldu = Triangular::split(*csrMatrix);
+    printf("Triangular::split: %.3f s\n", secondsSince(start));
+  }
+
+  // SpMV with each kernel, averaged over a few runs.
+  const int numRuns = 10;
+  auto csrMatrix = mmMatrix->toCSR();
+  auto cscMatrix = mmMatrix->toCSC();
+  auto cooMatrix = mmMatrix->toCOO();
+  auto deltaMatrix = mmMatrix->toDeltaCSR();
+  printf("index bytes CSR: %zu, DeltaCSR: %zu\n", (csrMatrix->N + 1 + csrMatrix->NZ) * sizeof(int),
+         deltaMatrix->indexBytes());
+  std::vector<double> x(mmMatrix->M, 1.0);
+  std::vector<double> y(mmMatrix->N);
+  const SpMVKernel best = getSpMVKernel();
+  const char *kernelNames[] = { "scalar", "avx2", "avx512" };
+  // Time the AVX2 DeltaCSR decoder on every block, and the scalar one
+  // with the SCALAR kernel.
+  setDeltaCSRDecoding(DeltaCSRDecoding::VECTOR);
+  for (auto kernel : { SpMVKernel::SCALAR, SpMVKernel::AVX2, SpMVKernel::AVX512 }) {
+    if (!setSpMVKernel(kernel))
+      continue;
+    auto start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmv(*csrMatrix, x.data(), y.data());
+    printf("spmv CSR %s: %.4f s\n", kernelNames[(int)kernel], secondsSince(start) / numRuns);
+    start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*csrMatrix, x.data(), y.data());
+    printf("spmvParallel CSR %s: %.4f s\n", kernelNames[(int)kernel], secondsSince(start) / numRuns);
+    start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmv(*deltaMatrix, x.data(), y.data());
+    printf("spmv DeltaCSR %s: %.4f s\n", kernelNames[(int)kernel], secondsSince(start) / numRuns);
+    start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*deltaMatrix, x.data(), y.data());
+    printf("spmvParallel DeltaCSR %s: %.4f s\n", kernelNames[(int)kernel], secondsSince(start) / numRuns);
+  }
+  setSpMVKernel(best);
+  setDeltaCSRDecoding(DeltaCSRDecoding::AUTO);
+  {
+    auto halfMatrix = mmMatrix->toCSR<float16>();
+    auto bhalfMatrix = mmMatrix->toCSR<bfloat16>();
+    auto patternMatrix = mmMatrix->toPatternCSR();
+    auto start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*halfMatrix, x.data(), y.data());
+    printf("spmvParallel CSR float16: %.4f s\n", secondsSince(start) / numRuns);
+    start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*bhalfMatrix, x.data(), y.data());
+    printf("spmvParallel CSR bfloat16: %.4f s\n", secondsSince(start) / numRuns);
+    start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*patternMatrix, x.data(), y.data());
+    printf("spmvParallel PatternCSR: %.4f s\n", secondsSince(start) / numRuns);
+  }
+  {
+    auto start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*cscMatrix, x.data(), y.data());
+    printf("spmvParallel CSC: %.4f s\n", secondsSince(start) / numRuns);
+  }
+  {
+    auto start = Clock::now();
+    for (int i = 0; i < numRuns; i++)
+      spmvParallel(*cooMatrix, x.data(), y.data());
+    printf("spmvParallel COO: %.4f s\n", secondsSince(start) / numRuns);
+  }
+  return 0;
+}
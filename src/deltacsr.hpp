@@ -0,0 +1,95 @@
+#pragma once
+
+#include "matrix.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <memory>
+
+namespace thundercat {
+  // Conversion to CSR with delta-encoded column indices (see
+  // DeltaCSRMatrix). Sorted rows, as toCSR produces, have non-negative
+  // differences; a block with rows that are not sorted gets 4 bytes per
+  // column, i.e. its columns are stored as they are.
+  class DeltaCSR {
+  public:
+    static const unsigned int defaultBlockSize = 16;
+
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<DeltaCSRMatrix<ValueType, IndexType>> convert(const CSRMatrix<ValueType, IndexType> &csr,
+                                                                         unsigned int blockSize = defaultBlockSize) {
+      if (blockSize == 0) {
+        std::cerr << "Delta CSR blocks need at least 1 row.\n";
+        exit(1);
+      }
+      if (csr.M > (unsigned int)std::numeric_limits<int32_t>::max()) {
+        std::cerr << "The matrix has too many columns for 4-byte deltas.\n";
+        exit(1);
+      }
+      const unsigned int numBlocks = (csr.N + blockSize - 1) / blockSize;
+
+      // Pick the width of each block and lay out the blocks.
+      unsigned char *widths = new unsigned char[numBlocks];
+      IndexType *offsets = new IndexType[numBlocks + 1];
+      long size = 0;
+      for (unsigned int block = 0; block < numBlocks; block++) {
+        const unsigned int rowEnd = std::min(csr.N, (block + 1) * blockSize);
+        long maxDelta = 0;
+        long numDeltas = 0;
+        for (unsigned int i = block * blockSize; i < rowEnd; i++) {
+          for (IndexType k = csr.rowPtr[i] + 1; k < csr.rowPtr[i + 1]; k++) {
+            long delta = (long)csr.colIndices[k] - csr.colIndices[k - 1];
+            maxDelta = delta < 0 ? std::numeric_limits<long>::max() : std::max(maxDelta, delta);
+            numDeltas++;
+          }
+        }
+        widths[block] = maxDelta <= std::numeric_limits<uint8_t>::max() ? 1 :
+                        maxDelta <= std::numeric_limits<uint16_t>::max() ? 2 : 4;
+        offsets[block] = size;
+        size = (size + numDeltas * widths[block] + 3) / 4 * 4;
+        if (size > std::numeric_limits<IndexType>::max()) {
+          std::cerr << "The deltas take too many bytes for " << sizeof(IndexType) * 8 << "-bit offsets.\n";
+          exit(1);
+        }
+      }
+      offsets[numBlocks] = size;
+
+      IndexType *rowPtr = new IndexType[csr.N + 1];
+      std::copy(csr.rowPtr, csr.rowPtr + csr.N + 1, rowPtr);
+      IndexType *firstCols = new IndexType[csr.N];
+      unsigned char *deltas = new unsigned char[size]();
+      ValueType *vals = new ValueType[csr.NZ];
+      std::copy(csr.values, csr.values + csr.NZ, vals);
+      for (unsigned int block = 0; block < numBlocks; block++) {
+        switch (widths[block]) {
+          case 1: encodeBlock<uint8_t>(csr, block, blockSize, deltas + offsets[block], firstCols); break;
+          case 2: encodeBlock<uint16_t>(csr, block, blockSize, deltas + offsets[block], firstCols); break;
+          default: encodeBlock<int32_t>(csr, block, blockSize, deltas + offsets[block], firstCols); break;
+        }
+      }
+
+      return std::make_unique<DeltaCSRMatrix<ValueType, IndexType>>(rowPtr, firstCols, offsets, widths, deltas,
+                                                                    vals, csr.N, csr.M, csr.NZ, blockSize);
+    }
+
+  private:
+    // Writes the first columns of the rows of a block, and its deltas as
+    // Delta values starting at out; 4-byte blocks get the columns instead.
+    template<typename Delta, typename ValueType, typename IndexType>
+    static void encodeBlock(const CSRMatrix<ValueType, IndexType> &csr, unsigned int block,
+                            unsigned int blockSize, unsigned char *out, IndexType *firstCols) {
+      Delta *deltas = (Delta*)out;
+      const unsigned int rowEnd = std::min(csr.N, (block + 1) * blockSize);
+      for (unsigned int i = block * blockSize; i < rowEnd; i++) {
+        const IndexType begin = csr.rowPtr[i];
+        const IndexType end = csr.rowPtr[i + 1];
+        firstCols[i] = begin < end ? csr.colIndices[begin] : 0;
+        for (IndexType k = begin + 1; k < end; k++) {
+          *deltas++ = sizeof(Delta) == 4 ? (Delta)csr.colIndices[k]
+                                         : (Delta)(csr.colIndices[k] - csr.colIndices[k - 1]);
+        }
+      }
+    }
+  };
+}
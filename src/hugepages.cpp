@@ -0,0 +1,70 @@
+#include "hugepages.hpp"
+#include <stdlib.h>
+#include <algorithm>
+#include <sys/mman.h>
+
+using namespace thundercat;
+
+static const size_t HUGE_PAGE_SIZE = 2 << 20;
+static const size_t ARRAY_ALIGNMENT = 64;
+
+static size_t alignUp(size_t size, size_t alignment) {
+  return (size + alignment - 1) / alignment * alignment;
+}
+
+HugePageBuffer::HugePageBuffer(char *memory, size_t length, bool mapped):
+  memory(memory), length(length), mapped(mapped) { }
+
+HugePageBuffer::~HugePageBuffer() {
+  if (mapped) {
+    munmap(memory, length);
+  } else {
+    free(memory);
+  }
+}
+
+std::shared_ptr<HugePageBuffer> HugePageBuffer::allocate(size_t size) {
+  size_t length = alignUp(std::max(size, (size_t)1), HUGE_PAGE_SIZE);
+
+#ifdef MAP_HUGETLB
+  void *addr = mmap(NULL, length, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+  if (addr != MAP_FAILED) {
+    return std::shared_ptr<HugePageBuffer>(new HugePageBuffer((char*)addr, length, true));
+  }
+#endif
+
+  // No reserved huge pages; fall back to transparent huge pages.
+  void *memory;
+  if (posix_memalign(&memory, HUGE_PAGE_SIZE, length) != 0) {
+    return nullptr;
+  }
+#ifdef MADV_HUGEPAGE
+  madvise(memory, length, MADV_HUGEPAGE);
+#endif
+  return std::shared_ptr<HugePageBuffer>(new HugePageBuffer((char*)memory, length, false));
+}
+
+HugePages::Layout::Layout(size_t indicesSize0, size_t indicesSize1, size_t valuesSize) {
+  sizes[0] = indicesSize0;
+  sizes[1] = indicesSize1;
+  sizes[2] = valuesSize;
+  size_t offset = 0;
+  for (int i = 0; i < 3; i++) {
+    offsets[i] = offset;
+    offset = alignUp(offset + sizes[i], ARRAY_ALIGNMENT);
+  }
+  totalSize = offset;
+}
+
+std::shared_ptr<HugePageBuffer> HugePages::allocate(const Layout &layout, const void *indices0,
+                                                    const void *indices1, const void *values) {
+  auto buffer = HugePageBuffer::allocate(layout.totalSize);
+  if (!buffer) {
+    return nullptr;
+  }
+  memcpy(buffer->data() + layout.offsets[0], indices0, layout.sizes[0]);
+  memcpy(buffer->data() + layout.offsets[1], indices1, layout.sizes[1]);
+  memcpy(buffer->data() + layout.offsets[2], values, layout.sizes[2]);
+  return buffer;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "matrix.hpp"
+#include <string.h>
+#include <memory>
+
+namespace thundercat {
+  // A single allocation aligned to 2 MB and backed by huge pages where the
+  // kernel allows it: explicitly reserved huge pages if available,
+  // transparent huge pages otherwise. Fewer TLB misses help the irregular
+  // accesses of sparse kernels on large matrices.
+  class HugePageBuffer {
+  public:
+    // Returns nullptr if the memory cannot be allocated.
+    static std::shared_ptr<HugePageBuffer> allocate(size_t size);
+
+    ~HugePageBuffer();
+
+    char *data() const {
+      return memory;
+    }
+
+    size_t size() const {
+      return length;
+    }
+
+  private:
+    char *memory;
+    size_t length;
+    // Whether the memory is a hugetlb mapping rather than a heap allocation.
+    bool mapped;
+
+    HugePageBuffer(char *memory, size_t length, bool mapped);
+    HugePageBuffer(const HugePageBuffer&) = delete;
+    HugePageBuffer& operator=(const HugePageBuffer&) = delete;
+  };
+
+  // Copies the arrays of a matrix into one huge-page buffer, which the
+  // returned matrix keeps alive. Returns nullptr if allocation fails.
+  class HugePages {
+  public:
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<COOMatrix<ValueType, IndexType>> copy(const COOMatrix<ValueType, IndexType> &matrix) {
+      Layout layout(matrix.NZ * sizeof(IndexType), matrix.NZ * sizeof(IndexType), matrix.NZ * sizeof(ValueType));
+      auto buffer = allocate(layout, matrix.rowIndices, matrix.colIndices, matrix.values);
+      if (!buffer)
+        return nullptr;
+      return std::make_unique<COOMatrix<ValueType, IndexType>>((IndexType*)(buffer->data() + layout.offsets[0]),
+                                                               (IndexType*)(buffer->data() + layout.offsets[1]),
+                                                               (ValueType*)(buffer->data() + layout.offsets[2]),
+                                                               matrix.N, matrix.M, matrix.NZ, buffer);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<CSRMatrix<ValueType, IndexType>> copy(const CSRMatrix<ValueType, IndexType> &matrix) {
+      Layout layout((matrix.N + 1) * sizeof(IndexType), matrix.NZ * sizeof(IndexType),
+                    matrix.NZ * sizeof(ValueType));
+      auto buffer = allocate(layout, matrix.rowPtr, matrix.colIndices, matrix.values);
+      if (!buffer)
+        return nullptr;
+      return std::make_unique<CSRMatrix<ValueType, IndexType>>((IndexType*)(buffer->data() + layout.offsets[0]),
+                                                               (IndexType*)(buffer->data() + layout.offsets[1]),
+                                                               (ValueType*)(buffer->data() + layout.offsets[2]),
+                                                               matrix.N, matrix.M, matrix.NZ, buffer);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<CSCMatrix<ValueType, IndexType>> copy(const CSCMatrix<ValueType, IndexType> &matrix) {
+      Layout layout(matrix.NZ * sizeof(IndexType), (matrix.M + 1) * sizeof(IndexType),
+                    matrix.NZ * sizeof(ValueType));
+      auto buffer = allocate(layout, matrix.rowIndices, matrix.colPtr, matrix.values);
+      if (!buffer)
+        return nullptr;
+      return std::make_unique<CSCMatrix<ValueType, IndexType>>((IndexType*)(buffer->data() + layout.offsets[0]),
+                                                               (IndexType*)(buffer->data() + layout.offsets[1]),
+                                                               (ValueType*)(buffer->data() + layout.offsets[2]),
+                                                               matrix.N, matrix.M, matrix.NZ, buffer);
+    }
+
+  private:
+    // Two index arrays followed by the values, each 64-byte aligned.
+    struct Layout {
+      size_t offsets[3];
+      size_t sizes[3];
+      size_t totalSize;
+
+      // The sizes are in bytes.
+      Layout(size_t indicesSize0, size_t indicesSize1, size_t valuesSize);
+    };
+
+    static std::shared_ptr<HugePageBuffer> allocate(const Layout &layout, const void *indices0,
+                                                    const void *indices1, const void *values);
+  };
+}
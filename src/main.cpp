@@ -2,12 +2,370 @@
 #include "matrix.hpp"
 #include "mmmatrix.hpp"
 #include "matrixprinter.hpp"
+#include "spmv.hpp"
+#include "streamloader.hpp"
+#include "transpose.hpp"
+#include "triangular.hpp"
+#include <algorithm>
+#include <fstream>
+#include <vector>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace thundercat;
 using namespace std;
 
 bool __DEBUG__ = false;
 
+template<typename ValueType>
+static void printVector(const char *name, std::vector<ValueType> const &vec) {
+  cout << name << ":";
+  for (ValueType val : vec) {
+    cout << " " << val;
+  }
+  cout << "\n";
+}
+
+template<typename ValueType, typename IndexType>
+static bool sameCSR(const CSRMatrix<ValueType, IndexType> &A, const CSRMatrix<ValueType, IndexType> &B) {
+  if (A.N != B.N || A.M != B.M || A.NZ != B.NZ)
+    return false;
+  return std::equal(A.rowPtr, A.rowPtr + A.N + 1, B.rowPtr) &&
+    std::equal(A.colIndices, A.colIndices + A.NZ, B.colIndices) &&
+    std::equal(A.values, A.values + A.NZ, B.values);
+}
+
+template<typename ValueType, typename IndexType>
+static bool sameCSC(const CSCMatrix<ValueType, IndexType> &A, const CSCMatrix<ValueType, IndexType> &B) {
+  if (A.N != B.N || A.M != B.M || A.NZ != B.NZ)
+    return false;
+  return std::equal(A.colPtr, A.colPtr + A.M + 1, B.colPtr) &&
+    std::equal(A.rowIndices, A.rowIndices + A.NZ, B.rowIndices) &&
+    std::equal(A.values, A.values + A.NZ, B.values);
+}
+
+template<typename ValueType, typename IndexType>
+static bool sameCOO(const COOMatrix<ValueType, IndexType> &A, const COOMatrix<ValueType, IndexType> &B) {
+  if (A.N != B.N || A.M != B.M || A.NZ != B.NZ)
+    return false;
+  return std::equal(A.rowIndices, A.rowIndices + A.NZ, B.rowIndices) &&
+    std::equal(A.colIndices, A.colIndices + A.NZ, B.colIndices) &&
+    std::equal(A.values, A.values + A.NZ, B.values);
+}
+
+template<typename ValueType, typename IndexType>
+static bool sameElements(MMMatrix<ValueType, IndexType> &A, MMMatrix<ValueType, IndexType> &B) {
+  MMElementView<ValueType, IndexType> a = A.getElementView();
+  MMElementView<ValueType, IndexType> b = B.getElementView();
+  if (A.N != B.N || A.M != B.M || a.size() != b.size() ||
+      A.isSortedRowMajor() != B.isSortedRowMajor() || A.isSortedColumnMajor() != B.isSortedColumnMajor())
+    return false;
+  return std::equal(a.rowIndices(), a.rowIndices() + a.size(), b.rowIndices()) &&
+    std::equal(a.colIndices(), a.colIndices() + a.size(), b.colIndices()) &&
+    std::equal(a.values(), a.values() + a.size(), b.values());
+}
+
+// DeltaCSR SpMV of a generated matrix with the AVX2 decoder forced, and
+// chosen per block, against the scalar decoder. Blocks of 8 rows take
+// turns at 1-, 2- and 4-byte deltas, and rows have up to 60 elements, so
+// the decoder runs on whole groups of four columns and on the rest.
+// Values and x are small integers, so the sums are exact in any order.
+template<typename ValueType>
+static bool sameDeltaCSRDecoding() {
+  const unsigned int N = 96;
+  const unsigned int M = 400000;
+  const unsigned int spreads[] = { 1, 300, 70000 };
+  MMMatrix<ValueType> matrix(N, M);
+  for (unsigned int i = 0; i < N; i++) {
+    const unsigned int spread = spreads[i / 8 % 3];
+    const unsigned int start = i % 100;
+    const unsigned int length = std::min((i * 13) % 61, (M - start) / spread);
+    for (unsigned int k = 0; k < length; k++) {
+      matrix.add(i, start + k * spread, (ValueType)((int)(k % 5) - 2));
+    }
+  }
+  std::unique_ptr<DeltaCSRMatrix<ValueType>> deltaMatrix = matrix.toDeltaCSR(8);
+  std::vector<ValueType> x(M);
+  for (unsigned int j = 0; j < M; j++) {
+    x[j] = j % 7 + 1;
+  }
+  std::vector<ValueType> scalarY(N);
+  std::vector<ValueType> vectorY(N);
+  std::vector<ValueType> autoY(N);
+  const DeltaCSRDecoding decoding = getDeltaCSRDecoding();
+  setDeltaCSRDecoding(DeltaCSRDecoding::SCALAR);
+  spmv(*deltaMatrix, x.data(), scalarY.data());
+  setDeltaCSRDecoding(DeltaCSRDecoding::VECTOR);
+  spmv(*deltaMatrix, x.data(), vectorY.data());
+  setDeltaCSRDecoding(DeltaCSRDecoding::AUTO);
+  spmvParallel(*deltaMatrix, x.data(), autoY.data(), 2);
+  setDeltaCSRDecoding(decoding);
+  return vectorY == scalarY && autoY == scalarY;
+}
+
+static long inode(const string &fileName) {
+  struct stat info;
+  return stat(fileName.c_str(), &info) == 0 ? (long)info.st_ino : -1;
+}
+
+// Snapshots of the matrix in a temporary directory: written and read back,
+// mapped, rejected when corrupted or read as another type, and the cache
+// of fromFileCached, which is rewritten when the storage asked for changes.
+static void printSnapshots(const string &matrixName, const COOMatrix<double> &coo,
+                           const CSRMatrix<double> &csr, const CSCMatrix<double> &csc) {
+  char dirName[] = "/tmp/testmatrixioXXXXXX";
+  if (mkdtemp(dirName) == NULL) {
+    cerr << "Could not create a temporary directory.\n";
+    exit(1);
+  }
+  const string dir(dirName);
+  const string cooName = dir + "/coo.bin";
+  const string csrName = dir + "/csr.bin";
+  const string cscName = dir + "/csc.bin";
+  cout << "written: " << Snapshot::write(cooName, coo) << " " << Snapshot::write(csrName, csr)
+       << " " << Snapshot::write(cscName, csc) << "\n";
+  cout << "read equals: " << sameCOO(*Snapshot::readCOO<double>(cooName), coo)
+       << " " << sameCSR(*Snapshot::readCSR<double>(csrName), csr)
+       << " " << sameCSC(*Snapshot::readCSC<double>(cscName), csc) << "\n";
+  cout << "mapped equals: " << sameCOO(*Snapshot::mapCOO<double>(cooName), coo)
+       << " " << sameCSR(*Snapshot::mapCSR<double>(csrName), csr)
+       << " " << sameCSC(*Snapshot::mapCSC<double>(cscName), csc) << "\n";
+  cout << "CSR read as float: " << (Snapshot::readCSR<float>(csrName) != nullptr)
+       << ", with long indices: " << (Snapshot::readCSR<double, long>(csrName) != nullptr)
+       << ", as COO: " << (Snapshot::readCOO<double>(csrName) != nullptr)
+       << ", mapped as CSC: " << (Snapshot::mapCSC<double>(csrName) != nullptr) << "\n";
+
+  // Flip the bits of the first value.
+  const uint64_t valuesOffset = Snapshot::open(csrName)->header.sectionOffsets[2];
+  FILE *f = fopen(csrName.c_str(), "r+b");
+  fseek(f, valuesOffset, SEEK_SET);
+  const int byte = fgetc(f);
+  fseek(f, valuesOffset, SEEK_SET);
+  fputc(byte ^ 0xFF, f);
+  fclose(f);
+  cout << "corrupted CSR read: " << (Snapshot::readCSR<double>(csrName) != nullptr)
+       << ", mapped: " << (Snapshot::mapCSR<double>(csrName) != nullptr)
+       << ", mapped and verified: " << (Snapshot::mapCSR<double>(csrName, true) != nullptr) << "\n";
+
+  // A copy of the matrix file, so that its cache goes to dir as well.
+  const string copyName = dir + "/matrix.mtx";
+  {
+    std::ifstream in(matrixName, std::ios::binary);
+    std::ofstream out(copyName, std::ios::binary);
+    out << in.rdbuf();
+  }
+  const string cacheName = Snapshot::cacheFileName(copyName);
+  std::unique_ptr<MMMatrix<double>> expanded = MMMatrix<double>::fromFile(matrixName);
+  std::unique_ptr<MMMatrix<double>> halfStored = MMMatrix<double>::fromFile(matrixName, defaultNumThreads(),
+                                                                            SymmetricStorage::HALF);
+  long cacheInode = -1;
+  for (SymmetricStorage storage : { SymmetricStorage::EXPANDED, SymmetricStorage::EXPANDED,
+                                    SymmetricStorage::HALF, SymmetricStorage::HALF, SymmetricStorage::EXPANDED }) {
+    std::unique_ptr<MMMatrix<double>> cached = MMMatrix<double>::fromFileCached(copyName, defaultNumThreads(), storage);
+    const bool half = storage == SymmetricStorage::HALF;
+    const long newInode = inode(cacheName);
+    cout << "cached " << (half ? "HALF" : "EXPANDED") << ": equals fromFile: "
+         << sameElements(*cached, half ? *halfStored : *expanded)
+         << ", cache written: " << (newInode != cacheInode)
+         << ", half-stored: " << Snapshot::open(cacheName)->header.halfStored << "\n";
+    cacheInode = newInode;
+  }
+
+  for (const string &fileName : { cooName, csrName, cscName, copyName, cacheName }) {
+    remove(fileName.c_str());
+  }
+  rmdir(dirName);
+}
+
+// CSR SpMV of a generated matrix with each vector kernel the CPU
+// supports, against the scalar kernel; a kernel that is not supported
+// counts as equal. Rows have up to 60 elements, so that the AVX-512 float
+// kernel runs on whole groups of 16 columns and on the rest. Values and x
+// are small integers, so the sums are exact in any order; float16 holds
+// them exactly too.
+template<typename ValueType>
+static void printSpMVKernels() {
+  const unsigned int N = 64;
+  const unsigned int M = 1000;
+  MMMatrix<ValueType> matrix(N, M);
+  for (unsigned int i = 0; i < N; i++) {
+    for (unsigned int k = 0; k < (i * 13) % 61; k++) {
+      matrix.add(i, (i + k * 16) % M, (ValueType)((int)(k % 5) - 2));
+    }
+  }
+  std::unique_ptr<CSRMatrix<ValueType>> csrMatrix = matrix.toCSR();
+  std::unique_ptr<CSRMatrix<float16>> halfMatrix = matrix.template toCSR<float16>();
+  std::vector<ValueType> x(M);
+  std::vector<double> doubleX(M);
+  for (unsigned int j = 0; j < M; j++) {
+    x[j] = doubleX[j] = j % 7 + 1;
+  }
+  std::vector<ValueType> scalarY(N);
+  std::vector<ValueType> vectorY(N);
+  std::vector<double> scalarHalfY(N);
+  std::vector<double> vectorHalfY(N);
+  const SpMVKernel kernel = getSpMVKernel();
+  setSpMVKernel(SpMVKernel::SCALAR);
+  spmv(*csrMatrix, x.data(), scalarY.data());
+  spmv(*halfMatrix, doubleX.data(), scalarHalfY.data());
+  const char *names[] = { "AVX2", "AVX512" };
+  for (SpMVKernel vectorKernel : { SpMVKernel::AVX2, SpMVKernel::AVX512 }) {
+    bool same = true;
+    if (setSpMVKernel(vectorKernel)) {
+      spmv(*csrMatrix, x.data(), vectorY.data());
+      spmvParallel(*halfMatrix, doubleX.data(), vectorHalfY.data(), 2);
+      same = vectorY == scalarY && vectorHalfY == scalarHalfY;
+      spmvParallel(*csrMatrix, x.data(), vectorY.data(), 3);
+      same = same && vectorY == scalarY;
+    }
+    cout << names[vectorKernel == SpMVKernel::AVX512] << " " << TypeName<ValueType>::name
+         << " CSR equals scalar: " << same << "\n";
+  }
+  setSpMVKernel(kernel);
+}
+
+// For each ordering, the permutation, and the bandwidth, profile and CSR
+// form of the permuted matrix.
+template<typename ValueType>
+static void printReorderings(MMMatrix<ValueType> &mmMatrix) {
+  if (mmMatrix.N != mmMatrix.M) {
+    cout << "not square, no reordering\n";
+    return;
+  }
+  std::unique_ptr<CSRMatrix<ValueType>> csrMatrix = mmMatrix.toCSR();
+  cout << "bandwidth: " << Reordering::bandwidth(*csrMatrix) << ", profile: " << Reordering::profile(*csrMatrix) << "\n";
+  const Ordering orderings[] = { Ordering::RCM, Ordering::DEGREE, Ordering::BISECTION };
+  const char *names[] = { "RCM", "degree", "bisection" };
+  for (int o = 0; o < 3; o++) {
+    std::vector<int> perm = mmMatrix.computeOrdering(orderings[o]);
+    printVector(names[o], perm);
+    std::unique_ptr<CSRMatrix<ValueType>> reorderedCSR = mmMatrix.permuted(perm)->toCSR();
+    cout << "bandwidth: " << Reordering::bandwidth(*reorderedCSR)
+         << ", profile: " << Reordering::profile(*reorderedCSR) << "\n";
+    MatrixPrinter::print(reorderedCSR);
+  }
+}
+
+// The orderings of a generated 20 x 20 grid whose vertices are numbered
+// in a scattered order, large enough for bisection to split it.
+static void printGridReorderings() {
+  const unsigned int side = 20;
+  const unsigned int N = side * side;
+  auto vertex = [&](unsigned int row, unsigned int col) { return (row * side + col) * 97 % N; };
+  MMMatrix<double> grid(N, N);
+  for (unsigned int row = 0; row < side; row++) {
+    for (unsigned int col = 0; col < side; col++) {
+      grid.add(vertex(row, col), vertex(row, col), 4.0);
+      if (row > 0) {
+        grid.add(vertex(row, col), vertex(row - 1, col), -1.0);
+        grid.add(vertex(row - 1, col), vertex(row, col), -1.0);
+      }
+      if (col > 0) {
+        grid.add(vertex(row, col), vertex(row, col - 1), -1.0);
+        grid.add(vertex(row, col - 1), vertex(row, col), -1.0);
+      }
+    }
+  }
+  std::unique_ptr<CSRMatrix<double>> csrMatrix = grid.toCSR();
+  cout << "grid bandwidth: " << Reordering::bandwidth(*csrMatrix)
+       << ", profile: " << Reordering::profile(*csrMatrix) << "\n";
+  const Ordering orderings[] = { Ordering::RCM, Ordering::DEGREE, Ordering::BISECTION };
+  const char *names[] = { "RCM", "degree", "bisection" };
+  for (int o = 0; o < 3; o++) {
+    std::unique_ptr<CSRMatrix<double>> reorderedCSR = grid.permuted(grid.computeOrdering(orderings[o]))->toCSR();
+    cout << "grid " << names[o] << " bandwidth: " << Reordering::bandwidth(*reorderedCSR)
+         << ", profile: " << Reordering::profile(*reorderedCSR) << "\n";
+  }
+}
+
+// Complex-valued files go through the complex ValueTraits, and for
+// Hermitian matrices, through conjugated mirroring.
+static void printComplex(const string &matrixName) {
+  typedef std::complex<double> Complex;
+  cout << "############### MM  ##############\n";
+  std::unique_ptr<MMMatrix<Complex>> mmMatrix = MMMatrix<Complex>::fromFile(matrixName);
+  MatrixPrinter::print(mmMatrix);
+  cout << "############### COO ##############\n";
+  std::unique_ptr<COOMatrix<Complex>> cooMatrix = mmMatrix->toCOO();
+  MatrixPrinter::print(cooMatrix);
+  cout << "############### CSR ##############\n";
+  std::unique_ptr<CSRMatrix<Complex>> csrMatrix = mmMatrix->toCSR();
+  MatrixPrinter::print(csrMatrix);
+  cout << "############### CSC ##############\n";
+  std::unique_ptr<CSCMatrix<Complex>> cscMatrix = mmMatrix->toCSC();
+  MatrixPrinter::print(cscMatrix);
+  cout << "############### SpMV ##############\n";
+  std::vector<Complex> x(mmMatrix->M);
+  std::vector<Complex> y(mmMatrix->N);
+  for (unsigned int j = 0; j < mmMatrix->M; j++) {
+    x[j] = Complex(j + 1, 1);
+  }
+  spmv(*csrMatrix, x.data(), y.data());
+  printVector("CSR", y);
+  spmv(*cscMatrix, x.data(), y.data());
+  printVector("CSC", y);
+  cout << "############### HALF ##############\n";
+  std::unique_ptr<MMMatrix<Complex>> halfStoredMatrix =
+    MMMatrix<Complex>::fromFile(matrixName, defaultNumThreads(), SymmetricStorage::HALF);
+  cout << "half-stored: " << halfStoredMatrix->isHalfStored() << "\n";
+  if (halfStoredMatrix->isHalfStored()) {
+    std::unique_ptr<CSRMatrix<Complex>> lowerMatrix = halfStoredMatrix->toSymmetricCSR();
+    MatrixPrinter::print(lowerMatrix);
+    spmvSymmetric(*lowerMatrix, x.data(), y.data(), halfStoredMatrix->getSymmetry());
+    printVector("spmvSymmetric", y);
+  }
+  cout << "############### Reordering ##############\n";
+  printReorderings(*mmMatrix);
+}
+
+// Level-scheduled solves of generated N x N triangular matrices whose
+// levels have many rows, so that each level is split among the threads.
+// Row i of L depends on row i - 1 within runs of 10 rows, and on a row
+// of an earlier run; U is L mirrored through the anti-diagonal.
+static void printLevelSolve(unsigned int N, unsigned int numThreads) {
+  MMMatrix<double> lower(N, N);
+  MMMatrix<double> upper(N, N);
+  auto add = [&](unsigned int i, unsigned int j, double val) {
+    lower.add(i, j, val);
+    upper.add(N - 1 - i, N - 1 - j, val);
+  };
+  for (unsigned int i = 0; i < N; i++) {
+    if (i >= 10) {
+      add(i, (i * 7) % (i - i % 10), 0.5);
+    }
+    if (i % 10 != 0) {
+      add(i, i - 1, -1.0);
+    }
+    add(i, i, 2.0 + i % 3);
+  }
+  std::unique_ptr<CSRMatrix<double>> L = lower.toCSR();
+  std::unique_ptr<CSRMatrix<double>> U = upper.toCSR();
+  std::vector<double> b(N);
+  for (unsigned int i = 0; i < N; i++) {
+    b[i] = i + 1;
+  }
+  std::vector<double> serialSolution(N);
+  std::vector<double> levelSolution(N);
+
+  LevelSchedule<> lowerSchedule = Triangular::analyze(*L, Triangle::LOWER);
+  cout << "generated L levels: " << lowerSchedule.numLevels() << ", max level size: " << lowerSchedule.maxLevelSize()
+       << ", parallelism: " << lowerSchedule.parallelism() << "\n";
+  Triangular::forwardSubstitution(*L, (const double*)nullptr, b.data(), serialSolution.data());
+  Triangular::solve(*L, (const double*)nullptr, lowerSchedule, b.data(), levelSolution.data(), numThreads);
+  cout << "level solve with " << numThreads << " threads equals forward substitution: "
+       << (levelSolution == serialSolution) << "\n";
+
+  LevelSchedule<> upperSchedule = Triangular::analyze(*U, Triangle::UPPER);
+  cout << "generated U levels: " << upperSchedule.numLevels() << ", max level size: " << upperSchedule.maxLevelSize()
+       << ", parallelism: " << upperSchedule.parallelism() << "\n";
+  Triangular::backwardSubstitution(*U, (const double*)nullptr, b.data(), serialSolution.data());
+  Triangular::solve(*U, (const double*)nullptr, upperSchedule, b.data(), levelSolution.data(), numThreads);
+  cout << "level solve with " << numThreads << " threads equals backward substitution: "
+       << (levelSolution == serialSolution) << "\n";
+}
+
 int main(int argc, const char *argv[]) {
   // Usage: ./test <matrixFilePath>
   if (argc < 2) {
@@ -15,9 +373,18 @@ int main(int argc, const char *argv[]) {
     exit(1);
   }
   string matrixName(argv[1]);
+  auto reader = MMReader::open(matrixName, true);
+  const bool complexValues = reader->isComplex();
+  reader.reset();
+  if (complexValues) {
+    printComplex(matrixName);
+    return 0;
+  }
   cout << "############### MM  ##############\n";
   std::unique_ptr<MMMatrix<double>> mmMatrix = MMMatrix<double>::fromFile(matrixName);
   MatrixPrinter::print(mmMatrix);
+  cout << "sorted row-major: " << mmMatrix->isSortedRowMajor()
+       << ", column-major: " << mmMatrix->isSortedColumnMajor() << "\n";
   cout << "############### LD  ##############\n";
   std::unique_ptr<MMMatrix<double>> ldMatrix = mmMatrix->getLD();
   MatrixPrinter::print(ldMatrix);
@@ -33,5 +400,208 @@ int main(int argc, const char *argv[]) {
   cout << "############### CSC ##############\n";
   std::unique_ptr<CSCMatrix<double>> cscMatrix = mmMatrix->toCSC();
   MatrixPrinter::print(cscMatrix);
-}
+  cout << "############### SELL ##############\n";
+  std::unique_ptr<SELLMatrix<double>> sellMatrix = mmMatrix->toSELL(2, 4);
+  MatrixPrinter::print(sellMatrix);
+  cout << "############### BCSR ##############\n";
+  std::unique_ptr<BCSRMatrix<double>> bcsrMatrix = mmMatrix->toBCSR(2, 2);
+  MatrixPrinter::print(bcsrMatrix);
+  cout << "############### DeltaCSR ##############\n";
+  std::unique_ptr<DeltaCSRMatrix<double>> deltaMatrix = mmMatrix->toDeltaCSR(2);
+  MatrixPrinter::print(deltaMatrix);
+  cout << "############### Duplicates ##############\n";
+  size_t numMerged = 0;
+  std::unique_ptr<CSRMatrix<double>> summedMatrix = mmMatrix->toCSR(Duplicates::SUM, &numMerged);
+  cout << "CSR summed, merged = " << numMerged << "\n";
+  MatrixPrinter::print(summedMatrix);
+  std::unique_ptr<COOMatrix<double>> lastMatrix = mmMatrix->toCOO(Duplicates::LAST, &numMerged);
+  cout << "COO last, merged = " << numMerged << "\n";
+  MatrixPrinter::print(lastMatrix);
+  std::unique_ptr<CSCMatrix<double>> maxMatrix = mmMatrix->toCSC(Duplicates::MAX, &numMerged);
+  cout << "CSC max, merged = " << numMerged << "\n";
+  MatrixPrinter::print(maxMatrix);
+  cout << "############### CSR float16 ##############\n";
+  std::unique_ptr<CSRMatrix<float16>> halfMatrix = mmMatrix->toCSR<float16>();
+  MatrixPrinter::print(halfMatrix);
+  cout << "############### CSR bfloat16 ##############\n";
+  std::unique_ptr<CSRMatrix<bfloat16>> bhalfMatrix = mmMatrix->toCSR<bfloat16>();
+  MatrixPrinter::print(bhalfMatrix);
+  cout << "############### PatternCSR ##############\n";
+  std::unique_ptr<PatternCSRMatrix<>> patternMatrix = mmMatrix->toPatternCSR();
+  MatrixPrinter::print(patternMatrix);
+  cout << "############### SpMV ##############\n";
+  std::vector<double> x(mmMatrix->M);
+  std::vector<double> y(mmMatrix->N);
+  for (unsigned int j = 0; j < mmMatrix->M; j++) {
+    x[j] = j + 1;
+  }
+  spmv(*csrMatrix, x.data(), y.data());
+  printVector("CSR", y);
+  spmvParallel(*csrMatrix, x.data(), y.data(), 2);
+  printVector("CSR parallel", y);
+  spmv(*cscMatrix, x.data(), y.data());
+  printVector("CSC", y);
+  spmvParallel(*cscMatrix, x.data(), y.data(), 2);
+  printVector("CSC parallel", y);
+  spmv(*cooMatrix, x.data(), y.data());
+  printVector("COO", y);
+  spmvParallel(*cooMatrix, x.data(), y.data(), 2);
+  printVector("COO parallel", y);
+  spmv(*sellMatrix, x.data(), y.data());
+  printVector("SELL", y);
+  spmvParallel(*sellMatrix, x.data(), y.data(), 2);
+  printVector("SELL parallel", y);
+  spmv(*bcsrMatrix, x.data(), y.data());
+  printVector("BCSR", y);
+  spmvParallel(*bcsrMatrix, x.data(), y.data(), 2);
+  printVector("BCSR parallel", y);
+  spmv(*deltaMatrix, x.data(), y.data());
+  printVector("DeltaCSR", y);
+  spmvParallel(*deltaMatrix, x.data(), y.data(), 2);
+  printVector("DeltaCSR parallel", y);
+  printSpMVKernels<double>();
+  printSpMVKernels<float>();
+  cout << "vector kernels for COO: " << setSpMVKernel(SpMVKernel::AVX2, SpMVFormat::COO)
+       << ", CSC: " << setSpMVKernel(SpMVKernel::AVX2, SpMVFormat::CSC)
+       << "; scalar for COO: " << setSpMVKernel(SpMVKernel::SCALAR, SpMVFormat::COO)
+       << ", CSC: " << setSpMVKernel(SpMVKernel::SCALAR, SpMVFormat::CSC) << "\n";
+  cout << "DeltaCSR vector decoding equals scalar, double: " << sameDeltaCSRDecoding<double>()
+       << ", float: " << sameDeltaCSRDecoding<float>() << "\n";
+  spmv(*halfMatrix, x.data(), y.data());
+  printVector("CSR float16", y);
+  spmvParallel(*halfMatrix, x.data(), y.data(), 2);
+  printVector("CSR float16 parallel", y);
+  spmv(*bhalfMatrix, x.data(), y.data());
+  printVector("CSR bfloat16", y);
+  spmvParallel(*bhalfMatrix, x.data(), y.data(), 2);
+  printVector("CSR bfloat16 parallel", y);
+  spmv(*patternMatrix, x.data(), y.data());
+  printVector("PatternCSR", y);
+  spmvParallel(*patternMatrix, x.data(), y.data(), 2);
+  printVector("PatternCSR parallel", y);
+  cout << "############### Shared ##############\n";
+  std::shared_ptr<const CSRMatrix<double>> sharedMatrix = mmMatrix->sharedCSR();
+  cout << "CSR reused: " << (mmMatrix->sharedCSR() == sharedMatrix) << "\n";
+  spmv(*mmMatrix->sharedLD(), x.data(), y.data());
+  printVector("LD", y);
+  spmv(*mmMatrix->sharedUD(), x.data(), y.data());
+  printVector("UD", y);
+  mmMatrix->add(0, 0, 1.0);
+  cout << "CSR reused after add: " << (mmMatrix->sharedCSR() == sharedMatrix) << "\n";
+  cout << "############### HALF ##############\n";
+  std::unique_ptr<MMMatrix<double>> halfStoredMatrix =
+    MMMatrix<double>::fromFile(matrixName, defaultNumThreads(), SymmetricStorage::HALF);
+  cout << "half-stored: " << halfStoredMatrix->isHalfStored() << "\n";
+  std::unique_ptr<CSRMatrix<double>> halfStoredCSR = halfStoredMatrix->toCSR();
+  MatrixPrinter::print(halfStoredCSR);
+  cout << "CSR equals expanded: " << sameCSR(*halfStoredCSR, *csrMatrix) << "\n";
+  if (halfStoredMatrix->isHalfStored()) {
+    std::unique_ptr<CSRMatrix<double>> lowerMatrix = halfStoredMatrix->toSymmetricCSR();
+    MatrixPrinter::print(lowerMatrix);
+    spmvSymmetric(*lowerMatrix, x.data(), y.data(), halfStoredMatrix->getSymmetry());
+    printVector("spmvSymmetric", y);
+  }
+  cout << "############### StreamLoader ##############\n";
+  for (unsigned int numThreads : { 1, 3 }) {
+    std::unique_ptr<CSRMatrix<double>> loadedCSR = StreamLoader<double>::loadCSR(matrixName, numThreads);
+    std::unique_ptr<CSCMatrix<double>> loadedCSC = StreamLoader<double>::loadCSC(matrixName, numThreads);
+    if (numThreads == 1) {
+      MatrixPrinter::print(loadedCSR);
+      MatrixPrinter::print(loadedCSC);
+    }
+    cout << numThreads << " threads, CSR equals toCSR: " << sameCSR(*loadedCSR, *csrMatrix)
+         << ", CSC equals toCSC: " << sameCSC(*loadedCSC, *cscMatrix) << "\n";
+  }
+  cout << "############### Transpose ##############\n";
+  std::unique_ptr<CSCMatrix<double>> transposedCSC = Transpose::toCSC(*csrMatrix, 2);
+  MatrixPrinter::print(transposedCSC);
+  std::unique_ptr<CSRMatrix<double>> transposedCSR = Transpose::toCSR(*transposedCSC, 2);
+  cout << "CSC equals toCSC: " << sameCSC(*transposedCSC, *cscMatrix)
+       << ", back to CSR equals toCSR: " << sameCSR(*transposedCSR, *csrMatrix) << "\n";
+  cout << "############### Triangular ##############\n";
+  if (csrMatrix->N == csrMatrix->M) {
+    LDU<double> ldu = Triangular::split(*csrMatrix, 2);
+    MatrixPrinter::print(ldu.L);
+    printVector("D", ldu.D);
+    MatrixPrinter::print(ldu.U);
+    LDU<double> serialLDU = Triangular::split(*csrMatrix, 0);
+    cout << "split with 0 threads equals: " << (sameCSR(*serialLDU.L, *ldu.L) && serialLDU.D == ldu.D
+                                                 && sameCSR(*serialLDU.U, *ldu.U)) << "\n";
+    if (std::find(ldu.D.begin(), ldu.D.end(), 0.0) == ldu.D.end()) {
+      LevelSchedule<> lowerSchedule = Triangular::analyze(*ldu.L, Triangle::LOWER);
+      cout << "L levels: " << lowerSchedule.numLevels() << ", max level size: " << lowerSchedule.maxLevelSize()
+           << ", parallelism: " << lowerSchedule.parallelism() << "\n";
+      std::vector<double> solution(csrMatrix->N);
+      Triangular::forwardSubstitution(*ldu.L, ldu.D.data(), x.data(), solution.data());
+      printVector("(L+D)^-1 x", solution);
+      std::vector<double> levelSolution(csrMatrix->N);
+      Triangular::solve(*ldu.L, ldu.D.data(), lowerSchedule, x.data(), levelSolution.data(), 2);
+      cout << "level solve with 2 threads equals substitution: " << (levelSolution == solution) << "\n";
 
+      LevelSchedule<> upperSchedule = Triangular::analyze(*ldu.U, Triangle::UPPER);
+      cout << "U levels: " << upperSchedule.numLevels() << ", max level size: " << upperSchedule.maxLevelSize()
+           << ", parallelism: " << upperSchedule.parallelism() << "\n";
+      Triangular::backwardSubstitution(*ldu.U, ldu.D.data(), x.data(), solution.data());
+      printVector("(D+U)^-1 x", solution);
+      Triangular::solve(*ldu.U, ldu.D.data(), upperSchedule, x.data(), levelSolution.data(), 2);
+      cout << "level solve with 2 threads equals substitution: " << (levelSolution == solution) << "\n";
+      printLevelSolve(1000, 4);
+    } else {
+      cout << "zero on the diagonal, no solve\n";
+    }
+  }
+  cout << "############### long indices ##############\n";
+  std::unique_ptr<MMMatrix<double, long>> longMatrix = MMMatrix<double, long>::fromFile(matrixName);
+  MatrixPrinter::print(longMatrix->toCOO());
+  std::unique_ptr<CSRMatrix<double, long>> longCSR = longMatrix->toCSR();
+  MatrixPrinter::print(longCSR);
+  MatrixPrinter::print(longMatrix->toCSC());
+  spmvParallel(*longCSR, x.data(), y.data(), 2);
+  printVector("CSR parallel", y);
+  std::unique_ptr<BCSRMatrix<double, long>> longBCSR = longMatrix->toBCSR(2, 2);
+  MatrixPrinter::print(longBCSR);
+  spmv(*longBCSR, x.data(), y.data());
+  printVector("BCSR", y);
+  spmvParallel(*longBCSR, x.data(), y.data(), 2);
+  printVector("BCSR parallel", y);
+  std::unique_ptr<MMMatrix<double, long>> longHalfStored =
+    MMMatrix<double, long>::fromFile(matrixName, defaultNumThreads(), SymmetricStorage::HALF);
+  if (longHalfStored->isHalfStored()) {
+    spmvSymmetric(*longHalfStored->toSymmetricCSR(), x.data(), y.data(), longHalfStored->getSymmetry());
+    printVector("spmvSymmetric", y);
+  }
+  if (longCSR->N == longCSR->M) {
+    LDU<double, long> longLDU = Triangular::split(*longCSR, 2);
+    if (std::find(longLDU.D.begin(), longLDU.D.end(), 0.0) == longLDU.D.end()) {
+      std::vector<double> solution(longCSR->N);
+      Triangular::solve(*longLDU.L, longLDU.D.data(), Triangular::analyze(*longLDU.L, Triangle::LOWER),
+                        x.data(), solution.data(), 2);
+      printVector("(L+D)^-1 x", solution);
+      Triangular::solve(*longLDU.U, longLDU.D.data(), Triangular::analyze(*longLDU.U, Triangle::UPPER),
+                        x.data(), solution.data(), 2);
+      printVector("(D+U)^-1 x", solution);
+    }
+    std::unique_ptr<MMMatrix<double, long>> longReordered =
+      longMatrix->permuted(longMatrix->computeOrdering(Ordering::RCM));
+    cout << "RCM:\n";
+    MatrixPrinter::print(longReordered->toCSR());
+  }
+  cout << "############### Reordering ##############\n";
+  printReorderings(*MMMatrix<double>::fromFile(matrixName));
+  printGridReorderings();
+  cout << "############### Chunks ##############\n";
+  // Chunks of a few lines, so that the parallel parsers split even these
+  // small files, against the parse in one chunk.
+  std::unique_ptr<MMMatrix<double>> oneChunkMatrix = MMMatrix<double>::fromFile(matrixName, 1);
+  const size_t minChunkSize = MMReader::getMinChunkSize();
+  MMReader::setMinChunkSize(16);
+  for (unsigned int numThreads : { 2, 5 }) {
+    cout << MMReader::open(matrixName)->split(numThreads).size() - 1 << " chunks, MM equals one chunk: "
+         << sameElements(*MMMatrix<double>::fromFile(matrixName, numThreads), *oneChunkMatrix)
+         << ", StreamLoader CSR equals toCSR: "
+         << sameCSR(*StreamLoader<double>::loadCSR(matrixName, numThreads), *csrMatrix) << "\n";
+  }
+  MMReader::setMinChunkSize(minChunkSize);
+  cout << "############### Snapshot ##############\n";
+  printSnapshots(matrixName, *cooMatrix, *csrMatrix, *cscMatrix);
+}
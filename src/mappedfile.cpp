@@ -0,0 +1,49 @@
+#include "mappedfile.hpp"
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace thundercat;
+
+MappedFile::MappedFile(const char *data, size_t length):
+  data(data), length(length) { }
+
+MappedFile::~MappedFile() {
+  if (length > 0) {
+    munmap((void*)data, length);
+  }
+}
+
+std::unique_ptr<MappedFile> MappedFile::open(std::string fileName, bool copyOnWrite) {
+  int fd = ::open(fileName.c_str(), O_RDONLY);
+  if (fd < 0) {
+    return nullptr;
+  }
+
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    close(fd);
+    return nullptr;
+  }
+
+  size_t length = info.st_size;
+  if (length == 0) {
+    // mmap does not accept empty ranges.
+    close(fd);
+    return std::unique_ptr<MappedFile>(new MappedFile("", 0));
+  }
+
+  int protection = copyOnWrite ? PROT_READ | PROT_WRITE : PROT_READ;
+  void *addr = mmap(NULL, length, protection, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if (addr == MAP_FAILED) {
+    return nullptr;
+  }
+  if (!copyOnWrite) {
+    // Read-only mappings are typically read front to back.
+    madvise(addr, length, MADV_SEQUENTIAL);
+  }
+
+  return std::unique_ptr<MappedFile>(new MappedFile((const char*)addr, length));
+}
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <memory>
+#include <string>
+
+namespace thundercat {
+  // A whole file mapped into memory.
+  // The mapping is released when the object is destroyed.
+  class MappedFile {
+  public:
+    // Returns nullptr if the file cannot be opened or mapped.
+    // A copyOnWrite mapping can be written through writableBegin(); the
+    // pages stay shared with the page cache (and thus with other processes
+    // mapping the same file) until they are written, and the file itself
+    // is never modified. Otherwise the mapping is read-only.
+    static std::unique_ptr<MappedFile> open(std::string fileName, bool copyOnWrite = false);
+
+    ~MappedFile();
+
+    const char *begin() const {
+      return data;
+    }
+
+    char *writableBegin() const {
+      return (char*)data;
+    }
+
+    const char *end() const {
+      return data + length;
+    }
+
+    size_t size() const {
+      return length;
+    }
+
+  private:
+    const char *data;
+    size_t length;
+
+    MappedFile(const char *data, size_t length);
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+  };
+}
@@ -2,8 +2,11 @@
 
 using namespace thundercat;
 
-Matrix::Matrix(unsigned int N, unsigned int M, unsigned int NZ):
-  N(N), M(M), NZ(NZ) { }
+Matrix::Matrix(unsigned int N, unsigned int M, size_t NZ):
+  N(N), M(M), NZ(NZ), ownsArrays(true) { }
+
+Matrix::Matrix(unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage):
+  N(N), M(M), NZ(NZ), ownsArrays(false), storage(storage) { }
 
 bool Matrix::isSquare() {
   return N == M;
@@ -1,77 +1,315 @@
 #pragma once
 
+#include <cstddef>
+#include <memory>
+
 namespace thundercat {
+  // Keeps alive the memory that holds the arrays of a matrix, such as a
+  // mapped file or an aligned allocation. The arrays are released when
+  // the last matrix (or other holder) referring to the storage goes away.
+  typedef std::shared_ptr<void> MatrixStorage;
+
   class Matrix {
   public:
     const unsigned int N; // num rows
     const unsigned int M; // num columns
-    const unsigned int NZ;
+    const size_t NZ;
     
-    Matrix(unsigned int N, unsigned int M, unsigned int NZ);
+    // The matrix owns its new[]-allocated arrays.
+    Matrix(unsigned int N, unsigned int M, size_t NZ);
+
+    // The arrays belong to storage. A null storage means
+    // the caller owns the arrays and keeps them alive.
+    Matrix(unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage);
     
     virtual ~Matrix() = 0;
     
     bool isSquare();
+
+  protected:
+    // Whether the arrays are delete[]'d with the matrix.
+    const bool ownsArrays;
+
+  private:
+    MatrixStorage storage;
   };
 
+  // The formats below store their indices and offsets as IndexType. int
+  // keeps the arrays small, which matters since SpMV is bound by memory
+  // bandwidth; long is needed once the number of elements (or of stored
+  // values, with padding or fill) exceeds 2^31 - 1.
+
   //===============================================
-  template<typename ValueType>
+  template<typename ValueType, typename IndexType = int>
   class COOMatrix : public Matrix {
   public:
-    int* __restrict rowIndices;
-    int* __restrict colIndices;
+    IndexType* __restrict rowIndices;
+    IndexType* __restrict colIndices;
     ValueType* __restrict values;
     
-    COOMatrix(int* __restrict rows, int* __restrict cols, ValueType* __restrict vals,
-              unsigned int N, unsigned int M, unsigned int NZ):
+    COOMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ):
     Matrix(N, M, NZ), rowIndices(rows), colIndices(cols), values(vals) {
     }
+
+    COOMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), rowIndices(rows), colIndices(cols), values(vals) {
+    }
     
     virtual ~COOMatrix() {
-      delete[] rowIndices;
-      delete[] colIndices;
-      delete[] values;
+      if (ownsArrays) {
+        delete[] rowIndices;
+        delete[] colIndices;
+        delete[] values;
+      }
     }
   };
 
   //===============================================
-  template<typename ValueType>
+  template<typename ValueType, typename IndexType = int>
   class CSRMatrix : public Matrix {
   public:
-    int* __restrict rowPtr;
-    int* __restrict colIndices;
+    IndexType* __restrict rowPtr;
+    IndexType* __restrict colIndices;
     ValueType* __restrict values;
 
-    CSRMatrix(int* __restrict rows, int* __restrict cols, ValueType* __restrict vals,
-              unsigned int N, unsigned int M, unsigned int NZ):
+    CSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ):
     Matrix(N, M, NZ), rowPtr(rows), colIndices(cols), values(vals) {
     }
 
+    CSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), rowPtr(rows), colIndices(cols), values(vals) {
+    }
+
     virtual ~CSRMatrix() {
-      delete[] rowPtr;
-      delete[] colIndices;
-      delete[] values;
+      if (ownsArrays) {
+        delete[] rowPtr;
+        delete[] colIndices;
+        delete[] values;
+      }
     }
   };
 
   //===============================================
-  template<typename ValueType>
+  // CSR without values, for pattern matrices, whose values are all 1.
+  // SpMV then reads only the indices.
+  template<typename IndexType = int>
+  class PatternCSRMatrix : public Matrix {
+  public:
+    IndexType* __restrict rowPtr;
+    IndexType* __restrict colIndices;
+
+    PatternCSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols,
+                     unsigned int N, unsigned int M, size_t NZ):
+    Matrix(N, M, NZ), rowPtr(rows), colIndices(cols) {
+    }
+
+    PatternCSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols,
+                     unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), rowPtr(rows), colIndices(cols) {
+    }
+
+    virtual ~PatternCSRMatrix() {
+      if (ownsArrays) {
+        delete[] rowPtr;
+        delete[] colIndices;
+      }
+    }
+  };
+
+  //===============================================
+  template<typename ValueType, typename IndexType = int>
   class CSCMatrix : public Matrix {
   public:
-    int* __restrict rowIndices;
-    int* __restrict colPtr;
+    IndexType* __restrict rowIndices;
+    IndexType* __restrict colPtr;
     ValueType* __restrict values;
 
-    CSCMatrix(int* __restrict rows, int* __restrict cols, ValueType* __restrict vals,
-              unsigned int N, unsigned int M, unsigned int NZ):
+    CSCMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ):
     Matrix(N, M, NZ), rowIndices(rows), colPtr(cols), values(vals) {      
     }
+
+    CSCMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+              unsigned int N, unsigned int M, size_t NZ, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), rowIndices(rows), colPtr(cols), values(vals) {
+    }
     
     virtual ~CSCMatrix() {
-      delete[] rowIndices;
-      delete[] colPtr;
-      delete[] values;
+      if (ownsArrays) {
+        delete[] rowIndices;
+        delete[] colPtr;
+        delete[] values;
+      }
     }
   };
-}
 
+  //===============================================
+  // SELL-C-sigma: the rows are sorted by decreasing length within windows
+  // of sigma rows, and the sorted rows are cut into chunks of C rows. Each
+  // chunk is padded to the length of its longest row and stored column-
+  // major, i.e. the j-th elements of the C rows of a chunk are adjacent,
+  // so that C SIMD lanes can process C rows at once. Sorting reduces the
+  // padding; sigma = 1 gives plain sliced ELLPACK, where rows keep their
+  // order.
+  template<typename ValueType, typename IndexType = int>
+  class SELLMatrix : public Matrix {
+  public:
+    const unsigned int C; // chunk height
+    const unsigned int sigma; // sorting window
+    const unsigned int numChunks;
+    IndexType* __restrict chunkPtr; // numChunks + 1 offsets into colIndices and values
+    IndexType* __restrict rowPerm; // N; the original index of each sorted row
+    // Padding slots have value 0, and repeat the last
+    // column index of their row (0 for empty rows). SpMV multiplies them
+    // too, so where x has an Inf or NaN, a row padded with its column
+    // gets NaN rather than the CSR result (e.g. 0 for an empty row).
+    IndexType* __restrict colIndices;
+    ValueType* __restrict values;
+
+    SELLMatrix(IndexType* __restrict chunks, IndexType* __restrict perm, IndexType* __restrict cols,
+               ValueType* __restrict vals, unsigned int N, unsigned int M, size_t NZ,
+               unsigned int C, unsigned int sigma):
+    Matrix(N, M, NZ), C(C), sigma(sigma), numChunks((N + C - 1) / C),
+    chunkPtr(chunks), rowPerm(perm), colIndices(cols), values(vals) {
+    }
+
+    SELLMatrix(IndexType* __restrict chunks, IndexType* __restrict perm, IndexType* __restrict cols,
+               ValueType* __restrict vals, unsigned int N, unsigned int M, size_t NZ,
+               unsigned int C, unsigned int sigma, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), C(C), sigma(sigma), numChunks((N + C - 1) / C),
+    chunkPtr(chunks), rowPerm(perm), colIndices(cols), values(vals) {
+    }
+
+    virtual ~SELLMatrix() {
+      if (ownsArrays) {
+        delete[] chunkPtr;
+        delete[] rowPerm;
+        delete[] colIndices;
+        delete[] values;
+      }
+    }
+
+    // The padded row length of a chunk.
+    int chunkLength(unsigned int chunk) const {
+      return (chunkPtr[chunk + 1] - chunkPtr[chunk]) / C;
+    }
+
+    // The number of slots, i.e. the elements plus the padding.
+    size_t paddedSize() const {
+      return chunkPtr[numChunks];
+    }
+
+    // The padding relative to the number of elements; 0 means no padding.
+    double paddingOverhead() const {
+      return NZ == 0 ? 0.0 : (double)(paddedSize() - NZ) / NZ;
+    }
+  };
+
+  //===============================================
+  // Blocked CSR: the matrix is tiled into r x c blocks, and the blocks that
+  // contain at least one element are stored in CSR format, each as a dense
+  // row-major array of r * c values. This stores one column index per
+  // block instead of one per element, and lets SpMV unroll over a block,
+  // at the cost of the explicit zeros that fill up the blocks.
+  template<typename ValueType, typename IndexType = int>
+  class BCSRMatrix : public Matrix {
+  public:
+    const unsigned int r; // block height
+    const unsigned int c; // block width
+    const unsigned int numBlockRows;
+    const size_t numBlocks;
+    IndexType* __restrict blockRowPtr; // numBlockRows + 1
+    IndexType* __restrict blockColIndices; // numBlocks; the first column of a block is c times this
+    ValueType* __restrict values; // numBlocks * r * c
+
+    BCSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+               unsigned int N, unsigned int M, size_t NZ,
+               unsigned int r, unsigned int c, size_t numBlocks):
+    Matrix(N, M, NZ), r(r), c(c), numBlockRows((N + r - 1) / r), numBlocks(numBlocks),
+    blockRowPtr(rows), blockColIndices(cols), values(vals) {
+    }
+
+    BCSRMatrix(IndexType* __restrict rows, IndexType* __restrict cols, ValueType* __restrict vals,
+               unsigned int N, unsigned int M, size_t NZ,
+               unsigned int r, unsigned int c, size_t numBlocks, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), r(r), c(c), numBlockRows((N + r - 1) / r), numBlocks(numBlocks),
+    blockRowPtr(rows), blockColIndices(cols), values(vals) {
+    }
+
+    virtual ~BCSRMatrix() {
+      if (ownsArrays) {
+        delete[] blockRowPtr;
+        delete[] blockColIndices;
+        delete[] values;
+      }
+    }
+
+    // The stored values, explicit zeros included, per element; 1 means
+    // the blocks are completely dense.
+    double fillRatio() const {
+      return NZ == 0 ? 1.0 : (double)numBlocks * r * c / NZ;
+    }
+  };
+
+  //===============================================
+  // CSR with compressed column indices: the first column of each row is
+  // stored in full, and each following one as its difference to the
+  // previous column of the row, in 1 or 2 bytes, or as is in 4 bytes. The
+  // width is chosen per block of blockSize rows, as the smallest one that
+  // holds the differences of the block. Rows whose elements are close
+  // together thus take about a byte per column index. The values are as
+  // in CSR.
+  template<typename ValueType, typename IndexType = int>
+  class DeltaCSRMatrix : public Matrix {
+  public:
+    const unsigned int blockSize; // rows per block
+    const unsigned int numBlocks;
+    IndexType* __restrict rowPtr; // N + 1 offsets into values
+    IndexType* __restrict firstCols; // N; 0 for empty rows
+    IndexType* __restrict blockOffsets; // numBlocks + 1 byte offsets into deltas, 4-byte aligned
+    unsigned char* __restrict blockWidths; // numBlocks; 1, 2 or 4
+    // Per row, its columns after the first: unsigned differences in 1- and
+    // 2-byte blocks, the columns themselves in 4-byte blocks.
+    unsigned char* __restrict deltas;
+    ValueType* __restrict values;
+
+    DeltaCSRMatrix(IndexType* __restrict rows, IndexType* __restrict firsts, IndexType* __restrict offsets,
+                   unsigned char* __restrict widths, unsigned char* __restrict deltas,
+                   ValueType* __restrict vals, unsigned int N, unsigned int M, size_t NZ,
+                   unsigned int blockSize):
+    Matrix(N, M, NZ), blockSize(blockSize), numBlocks((N + blockSize - 1) / blockSize),
+    rowPtr(rows), firstCols(firsts), blockOffsets(offsets), blockWidths(widths), deltas(deltas),
+    values(vals) {
+    }
+
+    DeltaCSRMatrix(IndexType* __restrict rows, IndexType* __restrict firsts, IndexType* __restrict offsets,
+                   unsigned char* __restrict widths, unsigned char* __restrict deltas,
+                   ValueType* __restrict vals, unsigned int N, unsigned int M, size_t NZ,
+                   unsigned int blockSize, MatrixStorage storage):
+    Matrix(N, M, NZ, storage), blockSize(blockSize), numBlocks((N + blockSize - 1) / blockSize),
+    rowPtr(rows), firstCols(firsts), blockOffsets(offsets), blockWidths(widths), deltas(deltas),
+    values(vals) {
+    }
+
+    virtual ~DeltaCSRMatrix() {
+      if (ownsArrays) {
+        delete[] rowPtr;
+        delete[] firstCols;
+        delete[] blockOffsets;
+        delete[] blockWidths;
+        delete[] deltas;
+        delete[] values;
+      }
+    }
+
+    // The bytes taken by the row pointers and the column indices, to
+    // compare with (N + 1 + NZ) * sizeof(IndexType) for CSR.
+    size_t indexBytes() const {
+      return (2 * (size_t)N + 1 + numBlocks + 1) * sizeof(IndexType) + numBlocks + blockOffsets[numBlocks];
+    }
+  };
+}
@@ -2,6 +2,7 @@
 
 #include "matrix.hpp"
 #include "mmmatrix.hpp"
+#include <complex>
 #include <iostream>
 
 namespace thundercat {
@@ -15,49 +16,64 @@ namespace thundercat {
   template<>
   const char* TypeName<float>::name = "float";
 
+  template<>
+  const char* TypeName<float16>::name = "float16";
+
+  template<>
+  const char* TypeName<bfloat16>::name = "bfloat16";
+
+  template<>
+  const char* TypeName< std::complex<double> >::name = "complex<double>";
+
+  template<>
+  const char* TypeName<int>::name = "int";
+
+  template<>
+  const char* TypeName<long>::name = "long";
+
   template<typename T>
   const char* TypeName<T>::name = "UNSUPPORTED_VALUE_TYPE";
 
   class MatrixPrinter {
   public:
 
-    template <typename ValueType>
-    static void print(std::unique_ptr<MMMatrix<ValueType>> const &mmMatrix) {
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<MMMatrix<ValueType, IndexType>> const &mmMatrix) {
       std::cout << mmMatrix->N << " " << mmMatrix->M << " " << mmMatrix->numElements() << "\n";
-      for (auto &elt : mmMatrix->getElements()) {
+      for (auto elt : mmMatrix->getElementView()) {
         std::cout << elt.rowIndex << " "
         << elt.colIndex << " "
         << elt.value << "\n";
       }
     }
     
-    template <typename ValueType>
-    static void printAsMTX(std::unique_ptr<MMMatrix<ValueType>> const &mmMatrix) {
+    template <typename ValueType, typename IndexType>
+    static void printAsMTX(std::unique_ptr<MMMatrix<ValueType, IndexType>> const &mmMatrix) {
       std::cout << mmMatrix->N << " " << mmMatrix->M << " " << mmMatrix->numElements() << "\n";
-      for (auto &elt : mmMatrix->getElements()) {
+      for (auto elt : mmMatrix->getElementView()) {
         std::cout << (elt.rowIndex + 1) << " "
         << (elt.colIndex + 1) << " "
         << elt.value << "\n";
       }
     }
     
-    template <typename ValueType>
-    static void print(std::unique_ptr<COOMatrix<ValueType>> const &cooMatrix) {
-      std::cout << "int rowIndices[" << cooMatrix->NZ << "] = {\n";
-      for(int i = 0; i < cooMatrix->NZ; ++i) {
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<COOMatrix<ValueType, IndexType>> const &cooMatrix) {
+      std::cout << TypeName<IndexType>::name << " rowIndices[" << cooMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < cooMatrix->NZ; ++i) {
         std::cout << cooMatrix->rowIndices[i] << ",\n";
       }
       std::cout << "};\n";
       
-      std::cout << "int colIndices[" << cooMatrix->NZ << "] = {\n";
-      for(int i = 0; i < cooMatrix->NZ; ++i) {
+      std::cout << TypeName<IndexType>::name << " colIndices[" << cooMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < cooMatrix->NZ; ++i) {
         std::cout << cooMatrix->colIndices[i] << ",\n";
       }
       std::cout << "};\n";
       
       std::cout << TypeName<ValueType>::name << " values[" << cooMatrix->NZ << "] = {\n";
-      for(int i = 0; i < cooMatrix->NZ; ++i) {
-        if(cooMatrix->values[i] == 0)
+      for(size_t i = 0; i < cooMatrix->NZ; ++i) {
+        if(cooMatrix->values[i] == ValueType())
           std::cout << "0.0,\n";
         else
           std::cout << cooMatrix->values[i] << ",\n";
@@ -65,23 +81,23 @@ namespace thundercat {
       std::cout << "};\n";
     }
 
-    template <typename ValueType>
-    static void print(std::unique_ptr<CSRMatrix<ValueType>> const &csrMatrix) {
-      std::cout << "int rowPtr[" << (csrMatrix->N + 1) << "] = {\n";
-      for(int i = 0; i < csrMatrix->N + 1; ++i) {
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<CSRMatrix<ValueType, IndexType>> const &csrMatrix) {
+      std::cout << TypeName<IndexType>::name << " rowPtr[" << (csrMatrix->N + 1) << "] = {\n";
+      for(size_t i = 0; i < csrMatrix->N + 1; ++i) {
         std::cout << csrMatrix->rowPtr[i] << ",\n";
       }
       std::cout << "};\n";
       
-      std::cout << "int colIndices[" << csrMatrix->NZ << "] = {\n";
-      for(int i = 0; i < csrMatrix->NZ; ++i) {
+      std::cout << TypeName<IndexType>::name << " colIndices[" << csrMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < csrMatrix->NZ; ++i) {
         std::cout << csrMatrix->colIndices[i] << ",\n";
       }
       std::cout << "};\n";
       
       std::cout << TypeName<ValueType>::name << " values[" << csrMatrix->NZ << "] = {\n";
-      for(int i = 0; i < csrMatrix->NZ; ++i) {
-        if(csrMatrix->values[i] == 0)
+      for(size_t i = 0; i < csrMatrix->NZ; ++i) {
+        if(csrMatrix->values[i] == ValueType())
           std::cout << "0.0,\n";
         else
           std::cout << csrMatrix->values[i] << ",\n";
@@ -89,29 +105,147 @@ namespace thundercat {
       std::cout << "};\n";
     }
 
-    template <typename ValueType>
-    static void print(std::unique_ptr<CSCMatrix<ValueType>> const &cscMatrix) {
-      std::cout << "int rowIndices[" << cscMatrix->NZ << "] = {\n";
-      for(int i = 0; i < cscMatrix->NZ; ++i) {
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<CSCMatrix<ValueType, IndexType>> const &cscMatrix) {
+      std::cout << TypeName<IndexType>::name << " rowIndices[" << cscMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < cscMatrix->NZ; ++i) {
         std::cout << cscMatrix->rowIndices[i] << ",\n";
       }
       std::cout << "};\n";
       
-      std::cout << "int colPtr[" << (cscMatrix->M + 1) << "] = {\n";
-      for(int i = 0; i < cscMatrix->M + 1; ++i) {
+      std::cout << TypeName<IndexType>::name << " colPtr[" << (cscMatrix->M + 1) << "] = {\n";
+      for(size_t i = 0; i < cscMatrix->M + 1; ++i) {
         std::cout << cscMatrix->colPtr[i] << ",\n";
       }
       std::cout << "};\n";
       
       std::cout << TypeName<ValueType>::name << " values[" << cscMatrix->NZ << "] = {\n";
-      for(int i = 0; i < cscMatrix->NZ; ++i) {
-        if(cscMatrix->values[i] == 0)
+      for(size_t i = 0; i < cscMatrix->NZ; ++i) {
+        if(cscMatrix->values[i] == ValueType())
           std::cout << "0.0,\n";
         else
           std::cout << cscMatrix->values[i] << ",\n";
       }
       std::cout << "};\n";
     }
+
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<SELLMatrix<ValueType, IndexType>> const &sellMatrix) {
+      std::cout << "C = " << sellMatrix->C << ", sigma = " << sellMatrix->sigma
+      << ", padding = " << sellMatrix->paddedSize() - sellMatrix->NZ << "\n";
+      std::cout << TypeName<IndexType>::name << " chunkPtr[" << (sellMatrix->numChunks + 1) << "] = {\n";
+      for(size_t i = 0; i < sellMatrix->numChunks + 1; ++i) {
+        std::cout << sellMatrix->chunkPtr[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " rowPerm[" << sellMatrix->N << "] = {\n";
+      for(size_t i = 0; i < sellMatrix->N; ++i) {
+        std::cout << sellMatrix->rowPerm[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " colIndices[" << sellMatrix->paddedSize() << "] = {\n";
+      for(size_t i = 0; i < sellMatrix->paddedSize(); ++i) {
+        std::cout << sellMatrix->colIndices[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<ValueType>::name << " values[" << sellMatrix->paddedSize() << "] = {\n";
+      for(size_t i = 0; i < sellMatrix->paddedSize(); ++i) {
+        if(sellMatrix->values[i] == ValueType())
+          std::cout << "0.0,\n";
+        else
+          std::cout << sellMatrix->values[i] << ",\n";
+      }
+      std::cout << "};\n";
+    }
+  
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<BCSRMatrix<ValueType, IndexType>> const &bcsrMatrix) {
+      const size_t numValues = bcsrMatrix->numBlocks * bcsrMatrix->r * bcsrMatrix->c;
+      std::cout << "r = " << bcsrMatrix->r << ", c = " << bcsrMatrix->c
+      << ", fill ratio = " << bcsrMatrix->fillRatio() << "\n";
+      std::cout << TypeName<IndexType>::name << " blockRowPtr[" << (bcsrMatrix->numBlockRows + 1) << "] = {\n";
+      for(size_t i = 0; i < bcsrMatrix->numBlockRows + 1; ++i) {
+        std::cout << bcsrMatrix->blockRowPtr[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " blockColIndices[" << bcsrMatrix->numBlocks << "] = {\n";
+      for(size_t i = 0; i < bcsrMatrix->numBlocks; ++i) {
+        std::cout << bcsrMatrix->blockColIndices[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<ValueType>::name << " values[" << numValues << "] = {\n";
+      for(size_t i = 0; i < numValues; ++i) {
+        if(bcsrMatrix->values[i] == ValueType())
+          std::cout << "0.0,\n";
+        else
+          std::cout << bcsrMatrix->values[i] << ",\n";
+      }
+      std::cout << "};\n";
+    }
+
+    template <typename IndexType>
+    static void print(std::unique_ptr<PatternCSRMatrix<IndexType>> const &patternMatrix) {
+      std::cout << TypeName<IndexType>::name << " rowPtr[" << (patternMatrix->N + 1) << "] = {\n";
+      for(size_t i = 0; i < patternMatrix->N + 1; ++i) {
+        std::cout << patternMatrix->rowPtr[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " colIndices[" << patternMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < patternMatrix->NZ; ++i) {
+        std::cout << patternMatrix->colIndices[i] << ",\n";
+      }
+      std::cout << "};\n";
+    }
+
+    template <typename ValueType, typename IndexType>
+    static void print(std::unique_ptr<DeltaCSRMatrix<ValueType, IndexType>> const &deltaMatrix) {
+      const size_t numDeltaBytes = deltaMatrix->blockOffsets[deltaMatrix->numBlocks];
+      std::cout << "blockSize = " << deltaMatrix->blockSize
+      << ", index bytes = " << deltaMatrix->indexBytes() << "\n";
+      std::cout << TypeName<IndexType>::name << " rowPtr[" << (deltaMatrix->N + 1) << "] = {\n";
+      for(size_t i = 0; i < deltaMatrix->N + 1; ++i) {
+        std::cout << deltaMatrix->rowPtr[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " firstCols[" << deltaMatrix->N << "] = {\n";
+      for(size_t i = 0; i < deltaMatrix->N; ++i) {
+        std::cout << deltaMatrix->firstCols[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<IndexType>::name << " blockOffsets[" << (deltaMatrix->numBlocks + 1) << "] = {\n";
+      for(size_t i = 0; i < deltaMatrix->numBlocks + 1; ++i) {
+        std::cout << deltaMatrix->blockOffsets[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << "unsigned char blockWidths[" << deltaMatrix->numBlocks << "] = {\n";
+      for(size_t i = 0; i < deltaMatrix->numBlocks; ++i) {
+        std::cout << (int)deltaMatrix->blockWidths[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << "unsigned char deltas[" << numDeltaBytes << "] = {\n";
+      for(size_t i = 0; i < numDeltaBytes; ++i) {
+        std::cout << (int)deltaMatrix->deltas[i] << ",\n";
+      }
+      std::cout << "};\n";
+
+      std::cout << TypeName<ValueType>::name << " values[" << deltaMatrix->NZ << "] = {\n";
+      for(size_t i = 0; i < deltaMatrix->NZ; ++i) {
+        if(deltaMatrix->values[i] == ValueType())
+          std::cout << "0.0,\n";
+        else
+          std::cout << deltaMatrix->values[i] << ",\n";
+      }
+      std::cout << "};\n";
+    }
   };
 }
-
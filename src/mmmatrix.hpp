@@ -1,78 +1,299 @@
 #pragma once
 
+#include "bcsr.hpp"
+#include "deltacsr.hpp"
 #include "matrix.hpp"
-#include "mmio.h"
+#include "mmreader.hpp"
+#include "parallel.hpp"
+#include "precision.hpp"
+#include "reordering.hpp"
+#include "snapshot.hpp"
+#include "valuetraits.hpp"
 #include <memory>
 #include <algorithm>
 #include <vector>
 #include <string>
 #include <iostream>
+#include <limits>
 
 namespace thundercat{
-template<typename ValueType>
+template<typename ValueType, typename IndexType = int>
 struct MMElement {
   // Unfortunately, can't make the members const, because sort() does not like this.
   // The workaround is uglier than having non-const members.
-  int rowIndex;
-  int colIndex;
+  IndexType rowIndex;
+  IndexType colIndex;
   ValueType value;
 
-  MMElement(const int row, const int col, const ValueType val):
+  MMElement(const IndexType row, const IndexType col, const ValueType val):
   rowIndex(row), colIndex(col), value(val) { }
     
-  static bool compareRowMajor(const MMElement<ValueType> &elt1, const MMElement<ValueType> &elt2) {
+  static bool compareRowMajor(const MMElement<ValueType, IndexType> &elt1,
+                              const MMElement<ValueType, IndexType> &elt2) {
     if (elt1.rowIndex < elt2.rowIndex) return true;
     else if (elt2.rowIndex < elt1.rowIndex) return false;
     else return elt1.colIndex < elt2.colIndex;
   }
 
-  static bool compareColumnMajor(const MMElement<ValueType> &elt1, const MMElement<ValueType> &elt2) {
+  static bool compareColumnMajor(const MMElement<ValueType, IndexType> &elt1,
+                                 const MMElement<ValueType, IndexType> &elt2) {
     if (elt1.colIndex < elt2.colIndex) return true;
     else if (elt2.colIndex < elt1.colIndex) return false;
     else return elt1.rowIndex < elt2.rowIndex;
   }
 };
 
-template<typename ValueType>
+// Elements stored as a structure of arrays, so that passes that only
+// need indices do not read the values.
+template<typename ValueType, typename IndexType = int>
+struct MMElements {
+  std::vector<IndexType> rowIndices;
+  std::vector<IndexType> colIndices;
+  std::vector<ValueType> values;
+
+  size_t size() const {
+    return values.size();
+  }
+
+  void reserve(size_t n) {
+    rowIndices.reserve(n);
+    colIndices.reserve(n);
+    values.reserve(n);
+  }
+
+  void resize(size_t n) {
+    rowIndices.resize(n);
+    colIndices.resize(n);
+    values.resize(n);
+  }
+
+  void push_back(IndexType row, IndexType col, ValueType val) {
+    rowIndices.push_back(row);
+    colIndices.push_back(col);
+    values.push_back(val);
+  }
+
+  void swap(MMElements<ValueType, IndexType> &other) {
+    rowIndices.swap(other.rowIndices);
+    colIndices.swap(other.colIndices);
+    values.swap(other.values);
+  }
+
+  // Reorders the elements so that the i'th one is the perm[i]'th one before.
+  void permute(const std::vector<IndexType> &perm) {
+    gather(rowIndices, perm);
+    gather(colIndices, perm);
+    gather(values, perm);
+  }
+
+private:
+  template<typename T>
+  static void gather(std::vector<T> &array, const std::vector<IndexType> &perm) {
+    std::vector<T> permuted(array.size());
+    for (size_t i = 0; i < perm.size(); i++) {
+      permuted[i] = array[perm[i]];
+    }
+    array.swap(permuted);
+  }
+};
+
+// Read-only view of the elements of an MMMatrix, without copying them.
+// Iterators yield MMElement values assembled from the underlying arrays.
+// The view is invalidated when the matrix is modified or sorted.
+template<typename ValueType, typename IndexType = int>
+class MMElementView {
+public:
+  class iterator {
+  public:
+    iterator(const MMElements<ValueType, IndexType> *elements, size_t index):
+    elements(elements), index(index) { }
+
+    MMElement<ValueType, IndexType> operator*() const {
+      return MMElement<ValueType, IndexType>(elements->rowIndices[index], elements->colIndices[index],
+                                             elements->values[index]);
+    }
+
+    iterator& operator++() {
+      index++;
+      return *this;
+    }
+
+    bool operator==(const iterator &other) const {
+      return index == other.index;
+    }
+
+    bool operator!=(const iterator &other) const {
+      return index != other.index;
+    }
+
+  private:
+    const MMElements<ValueType, IndexType> *elements;
+    size_t index;
+  };
+
+  MMElementView(const MMElements<ValueType, IndexType> &elements):
+  elements(elements) { }
+
+  iterator begin() const {
+    return iterator(&elements, 0);
+  }
+
+  iterator end() const {
+    return iterator(&elements, elements.size());
+  }
+
+  size_t size() const {
+    return elements.size();
+  }
+
+  MMElement<ValueType, IndexType> operator[](size_t i) const {
+    return MMElement<ValueType, IndexType>(elements.rowIndices[i], elements.colIndices[i], elements.values[i]);
+  }
+
+  const IndexType *rowIndices() const {
+    return elements.rowIndices.data();
+  }
+
+  const IndexType *colIndices() const {
+    return elements.colIndices.data();
+  }
+
+  const ValueType *values() const {
+    return elements.values.data();
+  }
+
+private:
+  const MMElements<ValueType, IndexType> &elements;
+};
+
+// How fromFile stores symmetric, skew-symmetric and Hermitian matrices.
+enum class SymmetricStorage {
+  // Each off-diagonal entry is also added mirrored, as an ordinary element.
+  EXPANDED,
+  // Only the entries in the file (i.e. one triangle) are kept;
+  // conversions expand the matrix on demand.
+  HALF
+};
+
+// How toCOO, toCSR and toCSC treat elements with the same (row, col).
+enum class Duplicates {
+  // All of them are kept, in the order they were added.
+  KEEP,
+  // They are merged into one element, whose value is their sum,
+  SUM,
+  // the value added last,
+  LAST,
+  // or the largest value (by magnitude, for complex values).
+  MAX
+};
+
+// IndexType is the type of the row and column indices, both of the
+// elements and of the formats converted to (see Matrix). Loading and
+// conversions exit if the matrix does not fit it.
+template<typename ValueType, typename IndexType = int>
 class MMMatrix {
 public:
   const unsigned int N;
   const unsigned int M;
 private:
-  std::vector< MMElement<ValueType> > elements;
-  const bool symmetric;
+  MMElements<ValueType, IndexType> elements;
+  const Symmetry symmetry;
+  // Whether the elements hold only one of each mirrored pair
+  // of a non-general matrix.
+  const bool halfStored;
+  // Whether the elements are known to be sorted by row, then column
+  // (by column, then row), so that sorting them can be skipped. Equal
+  // (row, col) pairs count as sorted. Kept up to date by add, and
+  // detected while loading.
+  bool sortedRowMajor;
+  bool sortedColumnMajor;
+
+  // The results of the shared* conversions, once made.
+  struct ConversionCache {
+    std::shared_ptr<const COOMatrix<ValueType, IndexType>> coo;
+    std::shared_ptr<const CSRMatrix<ValueType, IndexType>> csr;
+    std::shared_ptr<const CSCMatrix<ValueType, IndexType>> csc;
+    std::shared_ptr<const CSRMatrix<ValueType, IndexType>> ld;
+    std::shared_ptr<const CSRMatrix<ValueType, IndexType>> ud;
+    // Whether any of them is set, so that add, which getLD and getUD call
+    // per element, does not reset them all each time.
+    bool filled = false;
+  } cache;
+
+  void dropCache() {
+    if (cache.filled) {
+      cache = ConversionCache();
+    }
+  }
 
 public:
   MMMatrix(unsigned int N, unsigned int M):
-  N(N), M(M), symmetric(false) {
+  N(N), M(M), symmetry(Symmetry::GENERAL), halfStored(false), sortedRowMajor(true), sortedColumnMajor(true) {
   }
   
   MMMatrix(unsigned int N, unsigned int M, bool symmetric):
-  N(N), M(M), symmetric(symmetric) {
+  N(N), M(M), symmetry(symmetric ? Symmetry::SYMMETRIC : Symmetry::GENERAL), halfStored(false),
+  sortedRowMajor(true), sortedColumnMajor(true) {
+  }
+
+  MMMatrix(unsigned int N, unsigned int M, Symmetry symmetry, SymmetricStorage storage):
+  N(N), M(M), symmetry(symmetry),
+  halfStored(symmetry != Symmetry::GENERAL && storage == SymmetricStorage::HALF),
+  sortedRowMajor(true), sortedColumnMajor(true) {
   }
 
   virtual ~MMMatrix() = default;
 
-  const std::vector< MMElement<ValueType> > getElements() {
-    return elements;
+  // Returns a copy of the elements. Use getElementView to avoid the copy.
+  const std::vector< MMElement<ValueType, IndexType> > getElements() {
+    std::vector< MMElement<ValueType, IndexType> > result;
+    result.reserve(elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+      result.push_back(MMElement<ValueType, IndexType>(elements.rowIndices[i], elements.colIndices[i],
+                                                       elements.values[i]));
+    }
+    return result;
   }
   
-  unsigned int numElements() {
+  MMElementView<ValueType, IndexType> getElementView() {
+    return MMElementView<ValueType, IndexType>(elements);
+  }
+
+  // Moves the elements out of the matrix, which is left empty.
+  MMElements<ValueType, IndexType> releaseElements() {
+    MMElements<ValueType, IndexType> released;
+    released.swap(elements);
+    sortedRowMajor = true;
+    sortedColumnMajor = true;
+    dropCache();
+    return released;
+  }
+
+  // The number of stored elements; for a half-stored
+  // symmetric matrix, mirrored elements are not counted.
+  size_t numElements() {
     return elements.size();
   }
   
-  void add(int row, int col, ValueType val) {
-    elements.push_back(MMElement<ValueType>(row, col, val));
+  void add(IndexType row, IndexType col, ValueType val) {
+    if (elements.size() > 0) {
+      updateOrder(elements.rowIndices.back(), elements.colIndices.back(), row, col,
+                  sortedRowMajor, sortedColumnMajor);
+    }
+    elements.push_back(row, col, val);
+    dropCache();
   }
 
   bool hasFullDiagonal() {
     if (N != M)
       return false;
 
+    const IndexType *rows = elements.rowIndices.data();
+    const IndexType *cols = elements.colIndices.data();
     int diagValueCount = 0;
-    for (auto &elt : elements) {
-      if (elt.rowIndex == elt.colIndex) {
-        if (elt.value == 0.0)
+    for (size_t i = 0; i < elements.size(); i++) {
+      if (rows[i] == cols[i]) {
+        if (elements.values[i] == ValueType(0))
           return false;
         else
           diagValueCount++;
@@ -83,97 +304,344 @@ public:
   }
 
   bool isSymmetric() {
-    return symmetric;
+    return symmetry == Symmetry::SYMMETRIC;
+  }
+
+  Symmetry getSymmetry() {
+    return symmetry;
+  }
+
+  bool isHalfStored() {
+    return halfStored;
   }
 
   bool isSquare() {
     return N == M;
   }
+
+  bool isSortedRowMajor() {
+    return sortedRowMajor;
+  }
+
+  bool isSortedColumnMajor() {
+    return sortedColumnMajor;
+  }
   
-  std::unique_ptr<COOMatrix<ValueType>> toCOO() {
-    std::sort(elements.begin(), elements.end(), MMElement<ValueType>::compareRowMajor);
-    
-    long sz = elements.size();
-    int *rows = new int[sz];
-    int *cols = new int[sz];
+  // Sorts the elements by row, then by column.
+  // Equal (row, col) pairs keep their relative order.
+  // Nothing is done if they are known to be sorted; if they are sorted
+  // column-major, one counting sort by row is enough.
+  void sortRowMajor() {
+    if (sortedRowMajor)
+      return;
+    if (sortedColumnMajor) {
+      elements.permute(countingSort(elements.rowIndices, N, identity(elements.size())));
+    } else {
+      sortRowMajor(elements);
+    }
+    sortedRowMajor = true;
+    sortedColumnMajor = false;
+  }
+
+  // Sorts the elements by column, then by row, as sortRowMajor.
+  void sortColumnMajor() {
+    if (sortedColumnMajor)
+      return;
+    if (sortedRowMajor) {
+      elements.permute(countingSort(elements.colIndices, M, identity(elements.size())));
+    } else {
+      sortColumnMajor(elements);
+    }
+    sortedColumnMajor = true;
+    sortedRowMajor = false;
+  }
+
+  // Half-stored symmetric matrices are expanded in the result. Elements
+  // with the same (row, col) are kept or merged as duplicates says, while
+  // the sorted elements are copied out; if numMerged is not null, it gets
+  // the number of elements merged away.
+  std::unique_ptr<COOMatrix<ValueType, IndexType>> toCOO(Duplicates duplicates = Duplicates::KEEP,
+                                                         size_t *numMerged = nullptr) {
+    MMElements<ValueType, IndexType> expanded;
+    MMElements<ValueType, IndexType> &elements = rowMajorElements(expanded);
+    Coalescer coalescer(elements, elements.rowIndices, elements.colIndices, duplicates);
+
+    const size_t sz = coalescer.size();
+    IndexType *rows = new IndexType[sz];
+    IndexType *cols = new IndexType[sz];
     ValueType *vals = new ValueType[sz];
+    coalescer.write(rows, cols, vals, nullptr, N);
+    if (numMerged)
+      *numMerged = elements.size() - sz;
     
-    unsigned int eltIndex = 0;
-    for (auto &elt : elements) {
-      rows[eltIndex] = elt.rowIndex;
-      cols[eltIndex] = elt.colIndex;
-      vals[eltIndex] = elt.value;
-      eltIndex++;
-    }
+    return std::make_unique<COOMatrix<ValueType, IndexType>>(rows, cols, vals, N, M, sz);
+  }
+
+  // As toCOO for the symmetry and duplicates.
+  std::unique_ptr<CSRMatrix<ValueType, IndexType>> toCSR(Duplicates duplicates = Duplicates::KEEP,
+                                                         size_t *numMerged = nullptr) {
+    MMElements<ValueType, IndexType> expanded;
+    MMElements<ValueType, IndexType> &elements = rowMajorElements(expanded);
+    Coalescer coalescer(elements, elements.rowIndices, elements.colIndices, duplicates);
     
-    return std::make_unique<COOMatrix<ValueType>>(rows, cols, vals, N, M, sz);
+    const size_t sz = coalescer.size();
+    IndexType *rows = new IndexType[N + 1];
+    IndexType *cols = new IndexType[sz];
+    ValueType *vals = new ValueType[sz];
+    coalescer.write(nullptr, cols, vals, rows, N);
+    if (numMerged)
+      *numMerged = elements.size() - sz;
+    
+    return std::make_unique<CSRMatrix<ValueType, IndexType>>(rows, cols, vals, N, M, sz);
   }
 
-  std::unique_ptr<CSRMatrix<ValueType>> toCSR() {
-    std::sort(elements.begin(), elements.end(), MMElement<ValueType>::compareRowMajor);
+  // As toCOO for the symmetry and duplicates.
+  std::unique_ptr<CSCMatrix<ValueType, IndexType>> toCSC(Duplicates duplicates = Duplicates::KEEP,
+                                                         size_t *numMerged = nullptr) {
+    MMElements<ValueType, IndexType> expanded;
+    MMElements<ValueType, IndexType> &elements = columnMajorElements(expanded);
+    Coalescer coalescer(elements, elements.colIndices, elements.rowIndices, duplicates);
     
-    long sz = elements.size();
-    int *rows = new int[N + 1];
-    rows[0] = 0;
-    int *cols = new int[sz];
+    const size_t sz = coalescer.size();
+    IndexType *rows = new IndexType[sz];
+    IndexType *cols = new IndexType[M + 1];
     ValueType *vals = new ValueType[sz];
+    coalescer.write(nullptr, rows, vals, cols, M);
+    if (numMerged)
+      *numMerged = elements.size() - sz;
     
-    unsigned int eltIndex = 0;
-    unsigned int rowIndex = 0;
-    for (auto &elt : elements) {
-      cols[eltIndex] = elt.colIndex;
-      vals[eltIndex] = elt.value;
-      while (rowIndex != elt.rowIndex) {
-        rows[rowIndex + 1] = eltIndex;
-        rowIndex++;
-      }
-      eltIndex++;
+    return std::make_unique<CSCMatrix<ValueType, IndexType>>(rows, cols, vals, N, M, sz);
+  }
+
+  // Conversions made on first use and kept, for code that converts the
+  // same matrix in several places: later calls return the same matrix,
+  // which is shared and must not be changed. add and releaseElements
+  // drop the cached matrices; those already handed out stay valid, with
+  // the elements they were made from. Duplicates are kept, as in toCOO()
+  // etc. As those sort the elements in place, no two conversions may run
+  // concurrently on the same matrix.
+  std::shared_ptr<const COOMatrix<ValueType, IndexType>> sharedCOO() {
+    if (!cache.coo) {
+      cache.coo = toCOO();
+      cache.filled = true;
     }
-    while (rowIndex < N) {
-      rows[rowIndex + 1] = eltIndex;
-      rowIndex++;
+    return cache.coo;
+  }
+
+  std::shared_ptr<const CSRMatrix<ValueType, IndexType>> sharedCSR() {
+    if (!cache.csr) {
+      cache.csr = toCSR();
+      cache.filled = true;
     }
-    rows[N] = eltIndex;
-    
-    return std::make_unique<CSRMatrix<ValueType>>(rows, cols, vals, N, M, sz);
+    return cache.csr;
   }
 
-  std::unique_ptr<CSCMatrix<ValueType>> toCSC() {
-    std::sort(elements.begin(), elements.end(), MMElement<ValueType>::compareColumnMajor);
-    
-    long sz = elements.size();
-    int *rows = new int[sz];
-    int *cols = new int[M + 1];
-    cols[0] = 0;
+  std::shared_ptr<const CSCMatrix<ValueType, IndexType>> sharedCSC() {
+    if (!cache.csc) {
+      cache.csc = toCSC();
+      cache.filled = true;
+    }
+    return cache.csc;
+  }
+
+  // getLD() and getUD() in CSR format.
+  std::shared_ptr<const CSRMatrix<ValueType, IndexType>> sharedLD() {
+    if (!cache.ld) {
+      cache.ld = getLD()->toCSR();
+      cache.filled = true;
+    }
+    return cache.ld;
+  }
+
+  std::shared_ptr<const CSRMatrix<ValueType, IndexType>> sharedUD() {
+    if (!cache.ud) {
+      cache.ud = getUD()->toCSR();
+      cache.filled = true;
+    }
+    return cache.ud;
+  }
+
+  // A permutation of the rows and columns of a square matrix that moves
+  // the elements closer to the diagonal (see Reordering).
+  std::vector<IndexType> computeOrdering(Ordering ordering) {
+    auto csr = toCSR();
+    std::vector<int> perm = Reordering::compute(*csr, ordering);
+    return std::vector<IndexType>(perm.begin(), perm.end());
+  }
+
+  // Returns the matrix with its rows and columns permuted: new row
+  // (column) k is old row (column) perm[k]. The symmetry and the storage
+  // of symmetric matrices are kept.
+  std::unique_ptr<MMMatrix<ValueType, IndexType>> permuted(const std::vector<IndexType> &perm) {
+    std::vector<IndexType> inverse(N, -1);
+    bool valid = N == M && perm.size() == N;
+    for (size_t k = 0; valid && k < perm.size(); k++) {
+      valid = perm[k] >= 0 && (size_t)perm[k] < N && inverse[perm[k]] == -1;
+      if (valid)
+        inverse[perm[k]] = k;
+    }
+    if (!valid) {
+      std::cerr << "Not a permutation of the rows of a square matrix.\n";
+      exit(1);
+    }
+
+    auto matrix = std::make_unique<MMMatrix<ValueType, IndexType>>(N, M, symmetry, halfStored ? SymmetricStorage::HALF
+                                                                                   : SymmetricStorage::EXPANDED);
+    auto &permutedElements = matrix->elements;
+    permutedElements.resize(elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+      permutedElements.rowIndices[i] = inverse[elements.rowIndices[i]];
+      permutedElements.colIndices[i] = inverse[elements.colIndices[i]];
+      permutedElements.values[i] = elements.values[i];
+    }
+    matrix->sortedRowMajor = false;
+    matrix->sortedColumnMajor = false;
+    return matrix;
+  }
+
+  // Converts to SELL-C-sigma (see SELLMatrix), which takes C >= 1 and
+  // sigma >= 1. Half-stored symmetric matrices are expanded in the result.
+  std::unique_ptr<SELLMatrix<ValueType, IndexType>> toSELL(unsigned int C, unsigned int sigma) {
+    auto csr = toCSR();
+    std::vector<IndexType> rowLengths(N);
+    for (unsigned int i = 0; i < N; i++) {
+      rowLengths[i] = csr->rowPtr[i + 1] - csr->rowPtr[i];
+    }
+    std::vector<IndexType> perm = sellPermutation(rowLengths, sigma);
+    std::vector<long> widths = sellChunkLengths(rowLengths, perm, C);
+    const unsigned int numChunks = widths.size();
+    long sz = 0;
+    for (long width : widths) {
+      sz += width * C;
+    }
+    checkIndexRange(sz);
+
+    IndexType *chunkPtr = new IndexType[numChunks + 1];
+    chunkPtr[0] = 0;
+    for (unsigned int chunk = 0; chunk < numChunks; chunk++) {
+      chunkPtr[chunk + 1] = chunkPtr[chunk] + widths[chunk] * C;
+    }
+    IndexType *rowPerm = new IndexType[N];
+    std::copy(perm.begin(), perm.end(), rowPerm);
+    IndexType *cols = new IndexType[sz];
     ValueType *vals = new ValueType[sz];
-    
-    unsigned int eltIndex = 0;
-    unsigned int colIndex = 0;
-    for (auto &elt : elements) {
-      rows[eltIndex] = elt.rowIndex;
-      vals[eltIndex] = elt.value;
-      while (colIndex != elt.colIndex) {
-        cols[colIndex + 1] = eltIndex;
-        colIndex++;
+
+    for (unsigned int chunk = 0; chunk < numChunks; chunk++) {
+      for (unsigned int lane = 0; lane < C; lane++) {
+        unsigned int sortedRow = chunk * C + lane;
+        IndexType begin = 0;
+        IndexType length = 0;
+        if (sortedRow < N) {
+          begin = csr->rowPtr[perm[sortedRow]];
+          length = rowLengths[perm[sortedRow]];
+        }
+        IndexType paddingCol = length > 0 ? csr->colIndices[begin + length - 1] : 0;
+        for (long j = 0; j < widths[chunk]; j++) {
+          long slot = chunkPtr[chunk] + (long)j * C + lane;
+          if (j < length) {
+            cols[slot] = csr->colIndices[begin + j];
+            vals[slot] = csr->values[begin + j];
+          } else {
+            cols[slot] = paddingCol;
+            vals[slot] = 0;
+          }
+        }
+      }
+    }
+
+    return std::make_unique<SELLMatrix<ValueType, IndexType>>(chunkPtr, rowPerm, cols, vals, N, M, csr->NZ,
+                                                              C, sigma);
+  }
+
+  // The number of slots (elements plus padding) that toSELL(C, sigma)
+  // would allocate, computed from the row lengths only. Comparing this
+  // with the number of elements helps choosing C and sigma.
+  unsigned long sellPaddedSize(unsigned int C, unsigned int sigma) {
+    std::vector<IndexType> rowLengths(N, 0);
+    for (size_t i = 0; i < elements.size(); i++) {
+      rowLengths[elements.rowIndices[i]]++;
+      if (halfStored && elements.rowIndices[i] != elements.colIndices[i]) {
+        rowLengths[elements.colIndices[i]]++;
       }
-      eltIndex++;
     }
-    while (colIndex < M) {
-      cols[colIndex + 1] = eltIndex;
-      colIndex++;
+    std::vector<long> widths = sellChunkLengths(rowLengths, sellPermutation(rowLengths, sigma), C);
+    unsigned long size = 0;
+    for (long width : widths) {
+      size += width * C;
     }
-    cols[M] = eltIndex;
-    
-    return std::make_unique<CSCMatrix<ValueType>>(rows, cols, vals, N, M, sz);
+    return size;
+  }
+
+  // Converts to blocked CSR with r x c blocks (see BCSRMatrix).
+  // Half-stored symmetric matrices are expanded in the result.
+  std::unique_ptr<BCSRMatrix<ValueType, IndexType>> toBCSR(unsigned int r, unsigned int c) {
+    auto csr = toCSR();
+    return BCSR::convert(*csr, r, c);
+  }
+
+  // Like toBCSR(r, c), with the block size picked by BCSR::chooseBlockSize.
+  std::unique_ptr<BCSRMatrix<ValueType, IndexType>> toBCSR() {
+    auto csr = toCSR();
+    std::pair<unsigned int, unsigned int> blockSize = BCSR::chooseBlockSize(*csr);
+    return BCSR::convert(*csr, blockSize.first, blockSize.second);
+  }
+
+  // Like toCSR(), with the values stored as StoredType, e.g. float16 or
+  // bfloat16 (see Precision).
+  template<typename StoredType>
+  std::unique_ptr<CSRMatrix<StoredType, IndexType>> toCSR() {
+    auto csr = toCSR();
+    return Precision::convert<StoredType>(*csr);
+  }
+
+  // Like toCSR(), without the values, e.g. for pattern matrices.
+  std::unique_ptr<PatternCSRMatrix<IndexType>> toPatternCSR() {
+    auto csr = toCSR();
+    return Precision::pattern(*csr);
+  }
+
+  // Converts to CSR with delta-encoded column indices, whose widths are
+  // chosen per block of blockSize rows (see DeltaCSRMatrix).
+  // Half-stored symmetric matrices are expanded in the result.
+  std::unique_ptr<DeltaCSRMatrix<ValueType, IndexType>> toDeltaCSR(unsigned int blockSize = DeltaCSR::defaultBlockSize) {
+    auto csr = toCSR();
+    return DeltaCSR::convert(*csr, blockSize);
+  }
+
+  // Returns the lower triangle plus the diagonal of a symmetric (or skew-
+  // symmetric, Hermitian) matrix in CSR format, so that each mirrored pair
+  // is stored once. Entries stored in the upper triangle are mirrored into
+  // the lower one. This is the input of spmvSymmetric.
+  std::unique_ptr<CSRMatrix<ValueType, IndexType>> toSymmetricCSR() {
+    MMElements<ValueType, IndexType> lower;
+    for (size_t i = 0; i < elements.size(); i++) {
+      IndexType row = elements.rowIndices[i];
+      IndexType col = elements.colIndices[i];
+      if (row >= col) {
+        lower.push_back(row, col, elements.values[i]);
+      } else if (halfStored) {
+        lower.push_back(col, row, mirrorValue(symmetry, elements.values[i]));
+      }
+    }
+    MMMatrix<ValueType, IndexType> matrix(N, M);
+    matrix.elements.swap(lower);
+    // Without mirrored elements, lower keeps the order of the elements.
+    matrix.sortedRowMajor = sortedRowMajor && !halfStored;
+    matrix.sortedColumnMajor = sortedColumnMajor && !halfStored;
+    return matrix.toCSR();
   }
 
   // Return a new matrix that contains the lower triangular part plus the diagonal
-  std::unique_ptr<MMMatrix<ValueType>> getLD() {
-    auto matrix = std::make_unique<MMMatrix<ValueType>>(N, M);
+  std::unique_ptr<MMMatrix<ValueType, IndexType>> getLD() {
+    auto matrix = std::make_unique<MMMatrix<ValueType, IndexType>>(N, M);
     unsigned int count = 0;
-    for (auto &elt : elements) {
-      if (elt.rowIndex >= elt.colIndex) {
-        matrix->add(elt.rowIndex, elt.colIndex, elt.value);
+    for (size_t i = 0; i < elements.size(); i++) {
+      if (elements.rowIndices[i] >= elements.colIndices[i]) {
+        matrix->add(elements.rowIndices[i], elements.colIndices[i], elements.values[i]);
+        count++;
+      } else if (halfStored) {
+        matrix->add(elements.colIndices[i], elements.rowIndices[i],
+                    mirrorValue(symmetry, elements.values[i]));
         count++;
       }
     }
@@ -181,69 +649,392 @@ public:
   }
 
   // Return a new matrix that contains the upper triangular part plus the diagonal
-  std::unique_ptr<MMMatrix<ValueType>> getUD() {
-    auto matrix = std::make_unique<MMMatrix<ValueType>>(N, M);
+  std::unique_ptr<MMMatrix<ValueType, IndexType>> getUD() {
+    auto matrix = std::make_unique<MMMatrix<ValueType, IndexType>>(N, M);
     unsigned int count = 0;
-    for (auto &elt : elements) {
-      if (elt.rowIndex <= elt.colIndex) {
-        matrix->add(elt.rowIndex, elt.colIndex, elt.value);
+    for (size_t i = 0; i < elements.size(); i++) {
+      if (elements.rowIndices[i] <= elements.colIndices[i]) {
+        matrix->add(elements.rowIndices[i], elements.colIndices[i], elements.values[i]);
+        count++;
+      } else if (halfStored) {
+        matrix->add(elements.colIndices[i], elements.rowIndices[i],
+                    mirrorValue(symmetry, elements.values[i]));
         count++;
       }
     }
     return matrix;
   }
 
-  static std::unique_ptr<MMMatrix<ValueType>> fromFile(std::string fileName) {
-    FILE *f;
-    if ((f = fopen(fileName.c_str(), "r")) == NULL) {
-      std::cerr << "Problem opening file " << fileName << ".\n";
+private:
+  void sortRowMajor(MMElements<ValueType, IndexType> &elements) {
+    std::vector<IndexType> perm = countingSort(elements.colIndices, M, identity(elements.size()));
+    elements.permute(countingSort(elements.rowIndices, N, perm));
+  }
+
+  void sortColumnMajor(MMElements<ValueType, IndexType> &elements) {
+    std::vector<IndexType> perm = countingSort(elements.rowIndices, N, identity(elements.size()));
+    elements.permute(countingSort(elements.colIndices, M, perm));
+  }
+
+  // Copies elements sorted by their major, then minor index to the arrays
+  // of a conversion, merging each run of equal (row, col) as duplicates
+  // says. Merging is thus fused with the copy the conversions make anyway,
+  // and takes no extra pass over the values. The threads take parts of
+  // whole rows (columns, when column-major); the constructor counts what
+  // each part keeps, reading only the indices, so that the arrays can be
+  // allocated at their size.
+  class Coalescer {
+  public:
+    Coalescer(const MMElements<ValueType, IndexType> &elements, const std::vector<IndexType> &majors,
+              const std::vector<IndexType> &minors, Duplicates duplicates):
+    elements(elements), majors(majors), minors(minors), duplicates(duplicates) {
+      const size_t sz = elements.size();
+      const unsigned int numParts = std::max((size_t)1, std::min((size_t)defaultNumThreads(), sz));
+      bounds.assign(numParts + 1, sz);
+      bounds[0] = 0;
+      for (unsigned int part = 1; part < numParts; part++) {
+        size_t bound = std::max(bounds[part - 1], sz * part / numParts);
+        while (bound > 0 && bound < sz && majors[bound] == majors[bound - 1]) {
+          bound++;
+        }
+        bounds[part] = bound;
+      }
+
+      offsets.assign(numParts + 1, 0);
+      runParallel(numParts, [&](unsigned int part) {
+        size_t count = bounds[part + 1] - bounds[part];
+        if (duplicates != Duplicates::KEEP) {
+          for (size_t i = bounds[part] + 1; i < bounds[part + 1]; i++) {
+            count -= isDuplicate(i);
+          }
+        }
+        offsets[part + 1] = count;
+      });
+      for (unsigned int part = 0; part < numParts; part++) {
+        offsets[part + 1] += offsets[part];
+      }
+    }
+
+    // The number of elements kept.
+    size_t size() const {
+      return offsets.back();
+    }
+
+    // Writes the kept elements' major indices (if majorsOut is not null),
+    // minor indices and values, and if ptr is not null, the numMajor + 1
+    // offsets of the rows (columns) into them.
+    void write(IndexType *majorsOut, IndexType *minorsOut, ValueType *vals, IndexType *ptr, unsigned int numMajor) {
+      if (ptr) {
+        std::fill(ptr, ptr + numMajor + 1, 0);
+      }
+      runParallel(bounds.size() - 1, [&](unsigned int part) {
+        size_t out = offsets[part];
+        for (size_t i = bounds[part]; i < bounds[part + 1]; i++) {
+          if (i > bounds[part] && duplicates != Duplicates::KEEP && isDuplicate(i)) {
+            vals[out - 1] = merge(vals[out - 1], elements.values[i]);
+            continue;
+          }
+          if (majorsOut)
+            majorsOut[out] = majors[i];
+          minorsOut[out] = minors[i];
+          vals[out] = elements.values[i];
+          if (ptr)
+            ptr[majors[i] + 1]++;
+          out++;
+        }
+      });
+      if (ptr) {
+        for (unsigned int major = 0; major < numMajor; major++) {
+          ptr[major + 1] += ptr[major];
+        }
+      }
+    }
+
+  private:
+    const MMElements<ValueType, IndexType> &elements;
+    const std::vector<IndexType> &majors;
+    const std::vector<IndexType> &minors;
+    const Duplicates duplicates;
+    std::vector<size_t> bounds; // the parts, as ranges of the elements
+    std::vector<size_t> offsets; // where the output of each part begins
+
+    // Whether the i'th element is at the (row, col) of the one before.
+    bool isDuplicate(size_t i) const {
+      return majors[i] == majors[i - 1] && minors[i] == minors[i - 1];
+    }
+
+    ValueType merge(ValueType current, ValueType val) const {
+      switch (duplicates) {
+        case Duplicates::SUM: return current + val;
+        case Duplicates::LAST: return val;
+        case Duplicates::MAX: return ValueTraits<ValueType>::max(current, val);
+        default: return current;
+      }
+    }
+  };
+
+  // The elements of a conversion, sorted by row, then column: the elements
+  // themselves, sorted in place unless they are known to be, or for a
+  // half-stored symmetric matrix, the expanded elements in buffer.
+  MMElements<ValueType, IndexType> &rowMajorElements(MMElements<ValueType, IndexType> &buffer) {
+    MMElements<ValueType, IndexType> &expanded = expandedElements(buffer);
+    checkIndexRange(expanded.size());
+    if (halfStored) {
+      sortRowMajor(expanded);
+    } else {
+      sortRowMajor();
+    }
+    return expanded;
+  }
+
+  // As rowMajorElements, sorted by column, then row.
+  MMElements<ValueType, IndexType> &columnMajorElements(MMElements<ValueType, IndexType> &buffer) {
+    MMElements<ValueType, IndexType> &expanded = expandedElements(buffer);
+    checkIndexRange(expanded.size());
+    if (halfStored) {
+      sortColumnMajor(expanded);
+    } else {
+      sortColumnMajor();
+    }
+    return expanded;
+  }
+
+  // Clears rowMajor (columnMajor) unless element (row, col) may follow
+  // element (prevRow, prevCol) in row-major (column-major) order.
+  static void updateOrder(IndexType prevRow, IndexType prevCol, IndexType row, IndexType col,
+                          bool &rowMajor, bool &columnMajor) {
+    rowMajor = rowMajor && (prevRow < row || (prevRow == row && prevCol <= col));
+    columnMajor = columnMajor && (prevCol < col || (prevCol == col && prevRow <= row));
+  }
+
+  // Returns the elements themselves, or for a half-stored symmetric matrix,
+  // a copy in buffer with the mirrored elements added.
+  MMElements<ValueType, IndexType> &expandedElements(MMElements<ValueType, IndexType> &buffer) {
+    if (!halfStored)
+      return elements;
+
+    buffer.reserve(2 * elements.size());
+    for (size_t i = 0; i < elements.size(); i++) {
+      IndexType row = elements.rowIndices[i];
+      IndexType col = elements.colIndices[i];
+      buffer.push_back(row, col, elements.values[i]);
+      if (row != col) {
+        buffer.push_back(col, row, mirrorValue(symmetry, elements.values[i]));
+      }
+    }
+    return buffer;
+  }
+
+  // The rows ordered by decreasing length within windows of sigma rows.
+  static std::vector<IndexType> sellPermutation(const std::vector<IndexType> &rowLengths, unsigned int sigma) {
+    if (sigma == 0) {
+      std::cerr << "SELL-C-sigma needs sigma >= 1.\n";
       exit(1);
     }
-    
-    MM_typecode matcode;
-    if (mm_read_banner(f, &matcode) != 0) {
-      std::cerr << "Could not process Matrix Market banner.\n";
+    std::vector<IndexType> perm = identity(rowLengths.size());
+    for (size_t begin = 0; begin < perm.size(); begin += sigma) {
+      size_t end = std::min(perm.size(), begin + sigma);
+      std::stable_sort(perm.begin() + begin, perm.begin() + end, [&](IndexType a, IndexType b) {
+        return rowLengths[a] > rowLengths[b];
+      });
+    }
+    return perm;
+  }
+
+  // The padded row length of each chunk of C sorted rows.
+  static std::vector<long> sellChunkLengths(const std::vector<IndexType> &rowLengths,
+                                            const std::vector<IndexType> &perm, unsigned int C) {
+    if (C == 0) {
+      std::cerr << "SELL-C-sigma needs C >= 1.\n";
       exit(1);
     }
-    
-    if (!mm_is_matrix(matcode) || !mm_is_coordinate(matcode) || !mm_is_sparse(matcode)) {
-      std::cerr << "Only sparse matrices in coordinate format are handled.\n";
+    std::vector<long> widths((perm.size() + C - 1) / C, 0);
+    for (size_t i = 0; i < perm.size(); i++) {
+      widths[i / C] = std::max(widths[i / C], (long)rowLengths[perm[i]]);
+    }
+    return widths;
+  }
+
+  // Exits if n elements, or indices up to n, do not fit IndexType. This
+  // is where matrices too large for int indices are turned away.
+  static void checkIndexRange(size_t n) {
+    if (n > (size_t)std::numeric_limits<IndexType>::max()) {
+      std::cerr << "The matrix is too large for " << sizeof(IndexType) * 8
+                << "-bit indices; use a 64-bit IndexType.\n";
       exit(1);
     }
-    
-    if (mm_is_complex(matcode)) {
-      std::cerr << "Complex matrices are not handled.\n";
+  }
+
+  static std::vector<IndexType> identity(size_t size) {
+    std::vector<IndexType> perm(size);
+    for (size_t i = 0; i < perm.size(); i++) {
+      perm[i] = i;
+    }
+    return perm;
+  }
+
+  // Stable counting sort of the elements listed in perm by keys, which are
+  // bounded by numKeys. Returns the sorted permutation in O(NZ + numKeys)
+  // time; only the keys are read, not the rest of the elements.
+  static std::vector<IndexType> countingSort(const std::vector<IndexType> &keys, unsigned int numKeys,
+                                             const std::vector<IndexType> &perm) {
+    std::vector<size_t> offsets(numKeys + 1, 0);
+    for (IndexType key : keys) {
+      offsets[key + 1]++;
+    }
+    for (unsigned int key = 0; key < numKeys; key++) {
+      offsets[key + 1] += offsets[key];
+    }
+
+    std::vector<IndexType> sorted(perm.size());
+    for (IndexType index : perm) {
+      sorted[offsets[keys[index]]++] = index;
+    }
+    return sorted;
+  }
+
+public:
+  // The coordinate section is split into line-aligned chunks that are
+  // parsed concurrently into per-thread buffers, which are then
+  // concatenated in file order. The result does not depend on numThreads.
+  // Complex-valued files need a std::complex ValueType.
+  static std::unique_ptr<MMMatrix<ValueType, IndexType>> fromFile(std::string fileName,
+                                                                  unsigned int numThreads = defaultNumThreads(),
+                                                                  SymmetricStorage storage = SymmetricStorage::EXPANDED) {
+    auto reader = MMReader::open(fileName, ValueTraits<ValueType>::isComplex);
+    checkIndexRange(std::max(reader->N, reader->M));
+    const Symmetry symmetry = reader->getSymmetry();
+    auto matrix = std::make_unique<MMMatrix<ValueType, IndexType>>(reader->N, reader->M, symmetry, storage);
+    const bool expand = symmetry != Symmetry::GENERAL && !matrix->halfStored;
+
+    std::vector<const char*> bounds = reader->split(numThreads);
+    unsigned int numChunks = bounds.size() - 1;
+    std::vector< MMElements<ValueType, IndexType> > chunkElements(numChunks);
+    std::vector<long> chunkEntries(numChunks);
+    // Whether each chunk is sorted row-major (column-major).
+    std::vector< std::pair<bool, bool> > chunkOrders(numChunks);
+    std::atomic<bool> outOfBounds(false);
+    const long N = reader->N;
+    const long M = reader->M;
+    runParallel(numChunks, [&](unsigned int chunk) {
+      auto &buffer = chunkElements[chunk];
+      // Assume entries are spread evenly over the file.
+      buffer.reserve((long)reader->NZ * (bounds[chunk + 1] - bounds[chunk]) /
+                     std::max(1L, (long)(reader->bodyEnd() - reader->bodyBegin())) + 1);
+      bool rowMajor = true;
+      bool columnMajor = true;
+      auto push = [&](IndexType row, IndexType col, ValueType val) {
+        if (buffer.size() > 0) {
+          updateOrder(buffer.rowIndices.back(), buffer.colIndices.back(), row, col, rowMajor, columnMajor);
+        }
+        buffer.push_back(row, col, val);
+      };
+      chunkEntries[chunk] = reader->scanComplex(bounds[chunk], bounds[chunk + 1],
+                                                [&](long row, long col, double real, double imag) {
+        if (row < 0 || row >= N || col < 0 || col >= M || (expand && (col >= N || row >= M))) {
+          outOfBounds = true;
+          return;
+        }
+        ValueType val = ValueTraits<ValueType>::make(real, imag);
+        push(row, col, val);
+        if (expand && row != col) {
+          push(col, row, mirrorValue(symmetry, val));
+        }
+      });
+      chunkOrders[chunk] = std::make_pair(rowMajor, columnMajor);
+    });
+    if (outOfBounds) {
+      std::cerr << "Entry index out of bounds.\n";
       exit(1);
     }
-    
-    int N, M, NZ;
-    if ((mm_read_mtx_crd_size(f, &N, &M, &NZ)) != 0) {
-      std::cerr << "Could not read size information.\n";
+
+    long numEntries = 0;
+    std::vector<size_t> offsets(numChunks + 1, 0);
+    for (unsigned int chunk = 0; chunk < numChunks; chunk++) {
+      numEntries += chunkEntries[chunk];
+      offsets[chunk + 1] = offsets[chunk] + chunkElements[chunk].size();
+    }
+    if (numEntries != reader->NZ) {
+      std::cerr << "Expected " << reader->NZ << " entries, found " << numEntries << ".\n";
       exit(1);
     }
-    
-    // Read rows, cols, vals
-    auto matrix = std::make_unique<MMMatrix<ValueType>>(N, M, mm_is_symmetric(matcode));
-    int row; int col; double val;
-    
-    std::string line;
-    for (int i = 0; i < NZ; ++i) {
-      if (mm_is_pattern(matcode)) {
-        // Pattern (i.e. connectivity) matrices do not contain val entry.
-        // Such matrices are filled in with 1.0
-        fscanf(f, "%d %d\n", &row, &col);
-        val = 1.0;
-      } else {
-        fscanf(f, "%d %d %lg\n", &row, &col, &val);
+    checkIndexRange(offsets[numChunks]);
+
+    // The file is sorted if each chunk is, and each chunk may follow the
+    // last non-empty one before it.
+    const MMElements<ValueType, IndexType> *previous = nullptr;
+    for (unsigned int chunk = 0; chunk < numChunks; chunk++) {
+      const auto &buffer = chunkElements[chunk];
+      matrix->sortedRowMajor = matrix->sortedRowMajor && chunkOrders[chunk].first;
+      matrix->sortedColumnMajor = matrix->sortedColumnMajor && chunkOrders[chunk].second;
+      if (buffer.size() == 0)
+        continue;
+      if (previous) {
+        updateOrder(previous->rowIndices.back(), previous->colIndices.back(),
+                    buffer.rowIndices.front(), buffer.colIndices.front(),
+                    matrix->sortedRowMajor, matrix->sortedColumnMajor);
       }
-      // adjust to zero index
-      matrix->add(row-1, col-1, (ValueType)val);
-      if (mm_is_symmetric(matcode) && row != col) {
-        matrix->add(col-1, row-1, (ValueType)val);
+      previous = &buffer;
+    }
+
+    if (numChunks == 1) {
+      matrix->elements.swap(chunkElements[0]);
+    } else {
+      auto &elements = matrix->elements;
+      elements.resize(offsets[numChunks]);
+      runParallel(numChunks, [&](unsigned int chunk) {
+        auto &buffer = chunkElements[chunk];
+        std::copy(buffer.rowIndices.begin(), buffer.rowIndices.end(),
+                  elements.rowIndices.begin() + offsets[chunk]);
+        std::copy(buffer.colIndices.begin(), buffer.colIndices.end(),
+                  elements.colIndices.begin() + offsets[chunk]);
+        std::copy(buffer.values.begin(), buffer.values.end(),
+                  elements.values.begin() + offsets[chunk]);
+        MMElements<ValueType, IndexType>().swap(buffer);
+      });
+    }
+    return matrix;
+  }
+
+  // Like fromFile, but uses a binary snapshot kept next to the file
+  // (see Snapshot::cacheFileName) when it is newer than the file and
+  // has the same storage. Otherwise the file is parsed and the snapshot
+  // is (re)written.
+  static std::unique_ptr<MMMatrix<ValueType, IndexType>> fromFileCached(std::string fileName,
+                                                                        unsigned int numThreads = defaultNumThreads(),
+                                                                        SymmetricStorage storage = SymmetricStorage::EXPANDED) {
+    std::string cacheFileName = Snapshot::cacheFileName(fileName);
+    if (Snapshot::isNewer(cacheFileName, fileName)) {
+      auto snapshot = Snapshot::open(cacheFileName);
+      if (snapshot && snapshot->holds<ValueType, IndexType>(SnapshotFormat::COO) &&
+          (bool)snapshot->header.halfStored ==
+          (storage == SymmetricStorage::HALF && (Symmetry)snapshot->header.symmetry != Symmetry::GENERAL)) {
+        const SnapshotHeader &header = snapshot->header;
+        auto matrix = std::make_unique<MMMatrix<ValueType, IndexType>>(header.N, header.M,
+                                                                       (Symmetry)header.symmetry, storage);
+        const IndexType *rows = (const IndexType*)snapshot->section(0);
+        const IndexType *cols = (const IndexType*)snapshot->section(1);
+        const ValueType *vals = (const ValueType*)snapshot->section(2);
+        matrix->elements.rowIndices.assign(rows, rows + header.NZ);
+        matrix->elements.colIndices.assign(cols, cols + header.NZ);
+        matrix->elements.values.assign(vals, vals + header.NZ);
+        matrix->sortedRowMajor = header.order == SnapshotOrder::ROW_MAJOR;
+        matrix->sortedColumnMajor = header.order == SnapshotOrder::COLUMN_MAJOR;
+        return matrix;
       }
     }
-    if (f !=stdin) {
-      fclose(f);
+
+    auto matrix = fromFile(fileName, numThreads, storage);
+    SnapshotHeader header = Snapshot::makeHeader(SnapshotFormat::COO, SnapshotValueType<ValueType>::code,
+                                                 sizeof(ValueType), sizeof(IndexType), matrix->N, matrix->M,
+                                                 matrix->numElements(), matrix->symmetry,
+                                                 matrix->sortedRowMajor ? SnapshotOrder::ROW_MAJOR :
+                                                 matrix->sortedColumnMajor ? SnapshotOrder::COLUMN_MAJOR :
+                                                 SnapshotOrder::UNSORTED, matrix->halfStored);
+    MMElementView<ValueType, IndexType> view = matrix->getElementView();
+    const void *sections[] = { view.rowIndices(), view.colIndices(), view.values() };
+    if (!Snapshot::write(cacheFileName, header, sections)) {
+      std::cerr << "Could not write cache file " << cacheFileName << ".\n";
     }
     return matrix;
   }
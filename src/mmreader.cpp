@@ -0,0 +1,127 @@
+#include "mmreader.hpp"
+#include <stdio.h>
+#include <algorithm>
+#include <limits>
+
+using namespace thundercat;
+
+MMReader::MMReader(long N, long M, long NZ, const MM_typecode &matcode,
+                   std::unique_ptr<MappedFile> file, long bodyOffset):
+  N(N), M(M), NZ(NZ), file(std::move(file)), bodyOffset(bodyOffset) {
+  for (int i = 0; i < 4; i++) {
+    this->matcode[i] = matcode[i];
+  }
+}
+
+// Like mm_read_mtx_crd_size, but with long counts.
+static bool readSize(FILE *f, long &N, long &M, long &NZ) {
+  char line[MM_MAX_LINE_LENGTH];
+  do {
+    if (fgets(line, MM_MAX_LINE_LENGTH, f) == NULL)
+      return false;
+  } while (line[0] == '%');
+
+  if (sscanf(line, "%ld %ld %ld", &N, &M, &NZ) == 3)
+    return true;
+  int numItemsRead;
+  do {
+    numItemsRead = fscanf(f, "%ld %ld %ld", &N, &M, &NZ);
+    if (numItemsRead == EOF)
+      return false;
+  } while (numItemsRead != 3);
+  return true;
+}
+
+std::unique_ptr<MMReader> MMReader::open(std::string fileName, bool allowComplex) {
+  std::string error;
+  auto reader = tryOpen(fileName, allowComplex, error);
+  if (!reader) {
+    std::cerr << error;
+    exit(1);
+  }
+  return reader;
+}
+
+std::unique_ptr<MMReader> MMReader::tryOpen(std::string fileName, bool allowComplex, std::string &error) {
+  FILE *f;
+  if ((f = fopen(fileName.c_str(), "r")) == NULL) {
+    error = "Problem opening file " + fileName + ".\n";
+    return nullptr;
+  }
+
+  MM_typecode matcode;
+  if (mm_read_banner(f, &matcode) != 0) {
+    error = "Could not process Matrix Market banner.\n";
+    fclose(f);
+    return nullptr;
+  }
+
+  if (!mm_is_matrix(matcode) || !mm_is_coordinate(matcode) || !mm_is_sparse(matcode)) {
+    error = "Only sparse matrices in coordinate format are handled.\n";
+    fclose(f);
+    return nullptr;
+  }
+
+  if (mm_is_complex(matcode) && !allowComplex) {
+    error = "Complex matrices need a complex value type.\n";
+    fclose(f);
+    return nullptr;
+  }
+
+  long N, M, NZ;
+  if (!readSize(f, N, M, NZ)) {
+    error = "Could not read size information.\n";
+    fclose(f);
+    return nullptr;
+  }
+  if (N < 0 || M < 0 || NZ < 0 ||
+      N > std::numeric_limits<unsigned int>::max() || M > std::numeric_limits<unsigned int>::max()) {
+    error = "Matrix dimensions out of range.\n";
+    fclose(f);
+    return nullptr;
+  }
+  long bodyOffset = ftell(f);
+  fclose(f);
+
+  auto file = MappedFile::open(fileName);
+  if (!file) {
+    error = "Problem mapping file " + fileName + ".\n";
+    return nullptr;
+  }
+
+  return std::unique_ptr<MMReader>(new MMReader(N, M, NZ, matcode, std::move(file), bodyOffset));
+}
+
+static size_t &minChunkSize() {
+  static size_t bytes = 1 << 20;
+  return bytes;
+}
+
+size_t MMReader::getMinChunkSize() {
+  return minChunkSize();
+}
+
+void MMReader::setMinChunkSize(size_t bytes) {
+  minChunkSize() = std::max((size_t)1, bytes);
+}
+
+std::vector<const char*> MMReader::split(unsigned int maxChunks) const {
+  const char *begin = bodyBegin();
+  const char *end = bodyEnd();
+  size_t size = end - begin;
+  size_t numChunks = std::min((size_t)maxChunks, size / minChunkSize() + 1);
+  if (numChunks == 0) {
+    numChunks = 1;
+  }
+
+  std::vector<const char*> bounds;
+  bounds.push_back(begin);
+  for (size_t i = 1; i < numChunks; i++) {
+    const char *p = begin + size * i / numChunks;
+    // Move to the start of the next line, unless already there.
+    p = mmscanner::skipLine(p - 1, end);
+    bounds.push_back(std::max(p, bounds.back()));
+  }
+  bounds.push_back(end);
+  return bounds;
+}
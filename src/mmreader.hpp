@@ -0,0 +1,147 @@
+#pragma once
+
+#include "mappedfile.hpp"
+#include "mmio.h"
+#include "mmscanner.hpp"
+#include "valuetraits.hpp"
+#include <atomic>
+#include <iostream>
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace thundercat {
+  // Reads the coordinate section of a Matrix Market file.
+  // The header is processed with mmio; the entries are scanned
+  // from a memory mapping of the file.
+  class MMReader {
+  public:
+    const long N; // num rows
+    const long M; // num columns
+    const long NZ; // num entries stored in the file
+
+    // Prints an error and exits if the file is not a sparse matrix in
+    // coordinate format, or if it is complex-valued and !allowComplex.
+    // The size line is read with 64-bit counts, so that files with more
+    // than 2^31 - 1 entries can be opened; N and M must fit an unsigned int.
+    static std::unique_ptr<MMReader> open(std::string fileName, bool allowComplex = false);
+
+    // Like open, but returns null and sets error instead of exiting.
+    static std::unique_ptr<MMReader> tryOpen(std::string fileName, bool allowComplex, std::string &error);
+
+    bool isPattern() const {
+      return mm_is_pattern(matcode);
+    }
+
+    bool isComplex() const {
+      return mm_is_complex(matcode);
+    }
+
+    bool isSymmetric() const {
+      return mm_is_symmetric(matcode);
+    }
+
+    Symmetry getSymmetry() const {
+      if (mm_is_symmetric(matcode)) return Symmetry::SYMMETRIC;
+      if (mm_is_skew(matcode)) return Symmetry::SKEW_SYMMETRIC;
+      if (mm_is_hermitian(matcode)) return Symmetry::HERMITIAN;
+      return Symmetry::GENERAL;
+    }
+
+    // The part of the file after the size line.
+    const char *bodyBegin() const {
+      return file->begin() + bodyOffset;
+    }
+
+    const char *bodyEnd() const {
+      return file->end();
+    }
+
+    // Splits the body into at most maxChunks ranges of similar size that
+    // start at line boundaries. Returns the numChunks + 1 range bounds.
+    std::vector<const char*> split(unsigned int maxChunks) const;
+
+    // The smallest chunk split makes, in bytes; smaller chunks are not
+    // worth a thread of their own. 1 MB by default; tests lower it to
+    // split small files. Must not be changed while a file is being split.
+    static size_t getMinChunkSize();
+    static void setMinChunkSize(size_t bytes);
+
+    // Calls handler(row, col, val) with zero-based long indices for each entry
+    // whose line starts in [begin, end). Pattern entries get the value 1.0.
+    // Returns the number of entries. A malformed entry is an error, or
+    // if malformed is given, sets it and ends the scan.
+    template<typename Handler>
+    long scan(const char *begin, const char *end, Handler handler, std::atomic<bool> *malformed = nullptr) const {
+      return scanEntries<true>(begin, end, [&](long row, long col, double real, double) {
+        handler(row, col, real);
+      }, malformed);
+    }
+
+    // Like scan, but calls handler(row, col, real, imag).
+    // The imaginary part is 0 unless the file is complex-valued.
+    template<typename Handler>
+    long scanComplex(const char *begin, const char *end, Handler handler,
+                     std::atomic<bool> *malformed = nullptr) const {
+      return scanEntries<true>(begin, end, handler, malformed);
+    }
+
+    // Like scan, but calls handler(row, col) and does not convert the values.
+    template<typename Handler>
+    long scanIndices(const char *begin, const char *end, Handler handler,
+                     std::atomic<bool> *malformed = nullptr) const {
+      return scanEntries<false>(begin, end, [&](long row, long col, double, double) {
+        handler(row, col);
+      }, malformed);
+    }
+
+  private:
+    MM_typecode matcode;
+    std::unique_ptr<MappedFile> file;
+    const long bodyOffset;
+
+    template<bool withValues, typename Handler>
+    long scanEntries(const char *begin, const char *end, Handler handler, std::atomic<bool> *malformed) const {
+      const bool pattern = isPattern();
+      const bool complexValues = isComplex();
+      const char *fileEnd = bodyEnd();
+      const char *p = begin;
+      long count = 0;
+      while (true) {
+        p = mmscanner::skipSpaces(p, fileEnd);
+        if (p >= end)
+          break;
+        long row = 0;
+        long col = 0;
+        double real = 1.0;
+        double imag = 0.0;
+        bool valid = mmscanner::scanInt(p, fileEnd, row);
+        p = mmscanner::skipBlanks(p, fileEnd);
+        valid = valid && mmscanner::scanInt(p, fileEnd, col);
+        if (withValues && !pattern) {
+          p = mmscanner::skipBlanks(p, fileEnd);
+          valid = valid && mmscanner::scanDouble(p, fileEnd, real);
+          if (complexValues) {
+            p = mmscanner::skipBlanks(p, fileEnd);
+            valid = valid && mmscanner::scanDouble(p, fileEnd, imag);
+          }
+        }
+        if (!valid && malformed) {
+          *malformed = true;
+          break;
+        }
+        if (!valid) {
+          std::cerr << "Malformed entry in the coordinate section.\n";
+          exit(1);
+        }
+        handler(row - 1, col - 1, real, imag);
+        count++;
+        p = mmscanner::skipLine(p, fileEnd);
+      }
+      return count;
+    }
+
+    MMReader(long N, long M, long NZ, const MM_typecode &matcode,
+             std::unique_ptr<MappedFile> file, long bodyOffset);
+  };
+}
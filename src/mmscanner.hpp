@@ -0,0 +1,174 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <string>
+
+namespace thundercat {
+  // Tokenizer for the coordinate section of Matrix Market files.
+  // It works directly on character ranges (e.g. a mapped file), so that
+  // parsing does not pay for format-string interpretation and locale
+  // handling in the C library, as fscanf does.
+  namespace mmscanner {
+    inline bool isDigit(char c) {
+      return c >= '0' && c <= '9';
+    }
+
+    inline bool isSpace(char c) {
+      return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+    }
+
+    // Skips spaces and tabs, i.e. stays on the same line.
+    inline const char *skipBlanks(const char *p, const char *end) {
+      while (p != end && (*p == ' ' || *p == '\t')) p++;
+      return p;
+    }
+
+    inline const char *skipSpaces(const char *p, const char *end) {
+      while (p != end && isSpace(*p)) p++;
+      return p;
+    }
+
+    // Returns the position right after the next line break.
+    inline const char *skipLine(const char *p, const char *end) {
+      while (p != end && *p != '\n') p++;
+      return p == end ? end : p + 1;
+    }
+
+    inline const char *skipToken(const char *p, const char *end) {
+      while (p != end && !isSpace(*p)) p++;
+      return p;
+    }
+
+    inline bool scanInt(const char *&p, const char *end, long &result) {
+      const char *q = p;
+      bool negative = false;
+      if (q != end && (*q == '-' || *q == '+')) {
+        negative = *q == '-';
+        q++;
+      }
+      if (q == end || !isDigit(*q))
+        return false;
+
+      long value = 0;
+      for (; q != end && isDigit(*q); q++) {
+        if (value < 0x7fffffffffffffffL / 10)
+          value = value * 10 + (*q - '0');
+      }
+      result = negative ? -value : value;
+      p = q;
+      return true;
+    }
+
+    // Converts the token using strtod.
+    // Used for the inputs that the fast path below cannot convert exactly.
+    inline bool scanDoubleSlow(const char *&p, const char *end, double &result) {
+      const char *tokenEnd = skipToken(p, end);
+      // The token is copied because the range is not null-terminated.
+      char buffer[128];
+      std::string longToken;
+      const char *token = buffer;
+      size_t length = tokenEnd - p;
+      if (length < sizeof(buffer)) {
+        memcpy(buffer, p, length);
+        buffer[length] = '\0';
+      } else {
+        longToken.assign(p, tokenEnd);
+        token = longToken.c_str();
+      }
+      char *parsedEnd;
+      result = strtod(token, &parsedEnd);
+      if (parsedEnd == token)
+        return false;
+      p += parsedEnd - token;
+      return true;
+    }
+
+    // Parses a decimal floating-point number. Values whose significand fits
+    // in 53 bits and whose decimal exponent is small enough are computed
+    // with a single, correctly rounded multiplication or division
+    // (Clinger's fast path); everything else goes through strtod.
+    // Either way, the result is the same as fscanf's "%lg".
+    inline bool scanDouble(const char *&p, const char *end, double &result) {
+      static const double powersOf10[] = {
+        1e0,  1e1,  1e2,  1e3,  1e4,  1e5,  1e6,  1e7,  1e8,  1e9,  1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+      };
+      const uint64_t maxExactMantissa = 1ULL << 53;
+
+      const char *q = p;
+      bool negative = false;
+      if (q != end && (*q == '-' || *q == '+')) {
+        negative = *q == '-';
+        q++;
+      }
+
+      uint64_t mantissa = 0;
+      int numDigits = 0;
+      int exponent = 0;
+      bool anyDigits = false;
+      for (; q != end && isDigit(*q); q++) {
+        anyDigits = true;
+        if (mantissa != 0 || *q != '0') {
+          mantissa = mantissa * 10 + (*q - '0');
+          numDigits++;
+        }
+      }
+      if (q != end && *q == '.') {
+        q++;
+        for (; q != end && isDigit(*q); q++) {
+          anyDigits = true;
+          if (mantissa != 0 || *q != '0') {
+            mantissa = mantissa * 10 + (*q - '0');
+            numDigits++;
+          }
+          exponent--;
+        }
+      }
+      if (!anyDigits)
+        return scanDoubleSlow(p, end, result);
+
+      if (q != end && (*q == 'e' || *q == 'E')) {
+        q++;
+        bool negativeExponent = false;
+        if (q != end && (*q == '-' || *q == '+')) {
+          negativeExponent = *q == '-';
+          q++;
+        }
+        if (q == end || !isDigit(*q))
+          return scanDoubleSlow(p, end, result);
+        int exponentValue = 0;
+        for (; q != end && isDigit(*q); q++) {
+          if (exponentValue < 100000)
+            exponentValue = exponentValue * 10 + (*q - '0');
+        }
+        exponent += negativeExponent ? -exponentValue : exponentValue;
+      }
+      if (q != end && !isSpace(*q))
+        return scanDoubleSlow(p, end, result);
+      if (numDigits > 19)
+        return scanDoubleSlow(p, end, result);
+
+      // Move surplus exponent into the mantissa while it stays exact.
+      while (exponent > 22 && mantissa < maxExactMantissa / 10) {
+        mantissa *= 10;
+        exponent--;
+      }
+      if (mantissa > maxExactMantissa || exponent < -22 || exponent > 22) {
+        if (mantissa != 0)
+          return scanDoubleSlow(p, end, result);
+        exponent = 0;
+      }
+
+      double value = (double)mantissa;
+      if (exponent < 0)
+        value /= powersOf10[-exponent];
+      else
+        value *= powersOf10[exponent];
+      result = negative ? -value : value;
+      p = q;
+      return true;
+    }
+  }
+}
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  inline unsigned int defaultNumThreads() {
+    unsigned int numThreads = std::thread::hardware_concurrency();
+    return numThreads == 0 ? 1 : numThreads;
+  }
+
+  // Runs body(threadId) for threadId in [0, numThreads) concurrently
+  // and waits for all of them. Thread 0 is the calling thread. A
+  // numThreads of 0 counts as 1.
+  template<typename Body>
+  void runParallel(unsigned int numThreads, Body body) {
+    numThreads = std::max(1u, numThreads);
+    std::vector<std::thread> threads;
+    for (unsigned int t = 1; t < numThreads; t++) {
+      threads.emplace_back(body, t);
+    }
+    body(0);
+    for (auto &thread : threads) {
+      thread.join();
+    }
+  }
+
+  // Splits the rows (columns) [0, n) of a compressed matrix into numParts
+  // ranges with about the same number of elements, given the pointer
+  // array ptr[0..n] of int or long offsets. Returns the range of part t.
+  // A numParts of 0 counts as 1.
+  template<typename IndexType>
+  inline std::pair<size_t, size_t> balancedRange(const IndexType *ptr, size_t n, unsigned int t, unsigned int numParts) {
+    numParts = std::max(1u, numParts);
+    const long sz = ptr[n];
+    size_t begin = std::lower_bound(ptr, ptr + n, sz * t / numParts) - ptr;
+    size_t end = std::lower_bound(ptr, ptr + n, sz * (t + 1) / numParts) - ptr;
+    if (t == numParts - 1) {
+      end = n;
+    }
+    return std::make_pair(begin, end);
+  }
+
+  // Makes numThreads threads wait for each other: wait() returns once all
+  // of them have called it, and the writes made before the call are then
+  // visible to all of them. It can be reused right away. Waiting threads
+  // spin, yielding the processor, which suits short phases such as the
+  // levels of a triangular solve.
+  class Barrier {
+  public:
+    explicit Barrier(unsigned int numThreads): numThreads(numThreads), count(0), generation(0) { }
+
+    void wait() {
+      const unsigned int current = generation.load(std::memory_order_acquire);
+      if (count.fetch_add(1, std::memory_order_acq_rel) + 1 == numThreads) {
+        count.store(0, std::memory_order_relaxed);
+        generation.fetch_add(1, std::memory_order_release);
+      } else {
+        while (generation.load(std::memory_order_acquire) == current) {
+          std::this_thread::yield();
+        }
+      }
+    }
+
+  private:
+    const unsigned int numThreads;
+    std::atomic<unsigned int> count;
+    std::atomic<unsigned int> generation;
+  };
+}
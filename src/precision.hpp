@@ -0,0 +1,141 @@
+#pragma once
+
+#include "matrix.hpp"
+#include <stdint.h>
+#include <string.h>
+#include <algorithm>
+#include <memory>
+
+namespace thundercat {
+  // 16-bit floating point values, converted in software so that they work
+  // on any CPU. They are meant for storing matrix values, not for
+  // arithmetic: they convert to float implicitly, and from float with
+  // rounding to nearest even.
+  //
+  // float16 is IEEE 754 binary16: 5 exponent and 10 mantissa bits, i.e.
+  // about 3 decimal digits, with a range up to 65504; larger values
+  // become infinity. bfloat16 keeps the 8 exponent bits of float and 7
+  // mantissa bits, i.e. about 2 decimal digits, with the range of float.
+  struct float16 {
+    uint16_t bits;
+
+    float16() = default;
+
+    float16(float value): bits(fromFloat(value)) {
+    }
+
+    operator float() const {
+      return toFloat(bits);
+    }
+
+    static uint16_t fromFloat(float value) {
+      uint32_t f = floatBits(value);
+      const uint32_t sign = f & 0x80000000u;
+      f ^= sign;
+      uint16_t result;
+      if (f >= (127u + 16) << 23) {
+        // Too large: infinity; NaN stays (quiet) NaN.
+        result = f > 0x7f800000u ? 0x7e00 : 0x7c00;
+      } else if (f < (127u - 14) << 23) {
+        // Subnormal or zero: let the FPU round the mantissa into place.
+        const float denormMagic = bitsFloat(((127u - 15) + (23 - 10) + 1) << 23);
+        result = floatBits(bitsFloat(f) + denormMagic) - floatBits(denormMagic);
+      } else {
+        // Rebias the exponent and round the mantissa to nearest even.
+        const uint32_t odd = (f >> 13) & 1;
+        f += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        result = f >> 13;
+      }
+      return result | (sign >> 16);
+    }
+
+    static float toFloat(uint16_t h) {
+      const uint32_t shiftedExponent = 0x7c00u << 13;
+      uint32_t f = (h & 0x7fffu) << 13;
+      const uint32_t exponent = f & shiftedExponent;
+      f += (127u - 15) << 23;
+      if (exponent == shiftedExponent) {
+        // Infinity or NaN.
+        f += (128u - 16) << 23;
+      } else if (exponent == 0) {
+        // Subnormal: renormalize.
+        f += 1u << 23;
+        f = floatBits(bitsFloat(f) - bitsFloat(113u << 23));
+      }
+      return bitsFloat(f | (uint32_t)(h & 0x8000u) << 16);
+    }
+
+  private:
+    static uint32_t floatBits(float value) {
+      uint32_t result;
+      memcpy(&result, &value, sizeof(result));
+      return result;
+    }
+
+    static float bitsFloat(uint32_t bits) {
+      float result;
+      memcpy(&result, &bits, sizeof(result));
+      return result;
+    }
+  };
+
+  struct bfloat16 {
+    uint16_t bits;
+
+    bfloat16() = default;
+
+    bfloat16(float value): bits(fromFloat(value)) {
+    }
+
+    operator float() const {
+      return toFloat(bits);
+    }
+
+    static uint16_t fromFloat(float value) {
+      uint32_t f;
+      memcpy(&f, &value, sizeof(f));
+      if ((f & 0x7fffffffu) > 0x7f800000u) {
+        return (f >> 16) | 0x40; // quiet NaN
+      }
+      return (f + 0x7fff + ((f >> 16) & 1)) >> 16;
+    }
+
+    static float toFloat(uint16_t b) {
+      const uint32_t f = (uint32_t)b << 16;
+      float result;
+      memcpy(&result, &f, sizeof(result));
+      return result;
+    }
+  };
+
+  // Conversions of CSR matrices to cheaper value storage, since SpMV reads
+  // every value once and is bound by memory bandwidth: to a narrower type,
+  // e.g. float16 or bfloat16, which halves the value bytes of float and
+  // quarters those of double, or to no values at all for pattern matrices.
+  // SpMV on the results sums in double (see spmv.hpp).
+  class Precision {
+  public:
+    template<typename StoredType, typename ValueType, typename IndexType>
+    static std::unique_ptr<CSRMatrix<StoredType, IndexType>> convert(const CSRMatrix<ValueType, IndexType> &csr) {
+      IndexType *rowPtr = new IndexType[csr.N + 1];
+      std::copy(csr.rowPtr, csr.rowPtr + csr.N + 1, rowPtr);
+      IndexType *cols = new IndexType[csr.NZ];
+      std::copy(csr.colIndices, csr.colIndices + csr.NZ, cols);
+      StoredType *vals = new StoredType[csr.NZ];
+      for (size_t k = 0; k < csr.NZ; k++) {
+        vals[k] = StoredType(csr.values[k]);
+      }
+      return std::make_unique<CSRMatrix<StoredType, IndexType>>(rowPtr, cols, vals, csr.N, csr.M, csr.NZ);
+    }
+
+    // Drops the values, which are taken to be 1.
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<PatternCSRMatrix<IndexType>> pattern(const CSRMatrix<ValueType, IndexType> &csr) {
+      IndexType *rowPtr = new IndexType[csr.N + 1];
+      std::copy(csr.rowPtr, csr.rowPtr + csr.N + 1, rowPtr);
+      IndexType *cols = new IndexType[csr.NZ];
+      std::copy(csr.colIndices, csr.colIndices + csr.NZ, cols);
+      return std::make_unique<PatternCSRMatrix<IndexType>>(rowPtr, cols, csr.N, csr.M, csr.NZ);
+    }
+  };
+}
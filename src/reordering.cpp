@@ -0,0 +1,187 @@
+#include "reordering.hpp"
+
+using namespace thundercat;
+
+// Marks of vertices that have been placed, and of vertices that are
+// visited temporarily while looking for a peripheral vertex.
+static const int VISITED = -1;
+static const int PROBED = -2;
+
+Reordering::Graph::Graph(const int *rowPtr, const int *colIndices, int N):
+  numVertices(N) {
+  build(rowPtr, colIndices);
+}
+
+Reordering::Graph::Graph(const long *rowPtr, const long *colIndices, int N):
+  numVertices(N) {
+  build(rowPtr, colIndices);
+}
+
+template<typename IndexType>
+void Reordering::Graph::build(const IndexType *rowPtr, const IndexType *colIndices) {
+  const int N = numVertices;
+  ptr.assign(N + 1, 0);
+  for (int i = 0; i < N; i++) {
+    for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+      int j = colIndices[k];
+      if (j != i) {
+        ptr[i + 1]++;
+        ptr[j + 1]++;
+      }
+    }
+  }
+  for (int i = 0; i < N; i++) {
+    ptr[i + 1] += ptr[i];
+  }
+  adj.resize(ptr[N]);
+  std::vector<long> cursors(ptr.begin(), ptr.end() - 1);
+  for (int i = 0; i < N; i++) {
+    for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+      int j = colIndices[k];
+      if (j != i) {
+        adj[cursors[i]++] = j;
+        adj[cursors[j]++] = i;
+      }
+    }
+  }
+
+  // Drop the duplicate edges, compacting in place.
+  long size = 0;
+  for (int i = 0; i < N; i++) {
+    long begin = ptr[i];
+    long end = ptr[i + 1];
+    std::sort(adj.begin() + begin, adj.begin() + end);
+    ptr[i] = size;
+    for (long k = begin; k < end; k++) {
+      if (k == begin || adj[k] != adj[k - 1]) {
+        adj[size++] = adj[k];
+      }
+    }
+  }
+  ptr[N] = size;
+  adj.resize(size);
+}
+
+int Reordering::breadthFirst(const Graph &graph, int root, std::vector<int> &mark, int part, int visited,
+                             bool byDegree, std::vector<int> &order, size_t &lastLevel) {
+  size_t head = order.size();
+  order.push_back(root);
+  mark[root] = visited;
+  int numLevels = 0;
+  while (head < order.size()) {
+    lastLevel = head;
+    numLevels++;
+    for (size_t levelEnd = order.size(); head < levelEnd; head++) {
+      int v = order[head];
+      size_t first = order.size();
+      for (long k = graph.ptr[v]; k < graph.ptr[v + 1]; k++) {
+        int w = graph.adj[k];
+        if (mark[w] == part) {
+          mark[w] = visited;
+          order.push_back(w);
+        }
+      }
+      if (byDegree) {
+        std::sort(order.begin() + first, order.end(), [&](int a, int b) {
+          return graph.degree(a) < graph.degree(b) || (graph.degree(a) == graph.degree(b) && a < b);
+        });
+      }
+    }
+  }
+  return numLevels;
+}
+
+int Reordering::pseudoPeripheral(const Graph &graph, int start, std::vector<int> &mark, int part) {
+  int root = start;
+  int numLevels = 0;
+  std::vector<int> order;
+  while (true) {
+    order.clear();
+    size_t lastLevel;
+    int levels = breadthFirst(graph, root, mark, part, PROBED, false, order, lastLevel);
+    for (int v : order) {
+      mark[v] = part;
+    }
+    if (levels <= numLevels) {
+      return root;
+    }
+    numLevels = levels;
+    // Continue from a vertex of minimum degree in the last level.
+    int next = order[lastLevel];
+    for (size_t k = lastLevel; k < order.size(); k++) {
+      if (graph.degree(order[k]) < graph.degree(next)) {
+        next = order[k];
+      }
+    }
+    if (next == root) {
+      return root;
+    }
+    root = next;
+  }
+}
+
+std::vector<int> Reordering::degree(const Graph &graph) {
+  std::vector<int> perm(graph.numVertices);
+  for (int v = 0; v < graph.numVertices; v++) {
+    perm[v] = v;
+  }
+  std::stable_sort(perm.begin(), perm.end(), [&](int a, int b) {
+    return graph.degree(a) < graph.degree(b);
+  });
+  return perm;
+}
+
+std::vector<int> Reordering::reverseCuthillMcKee(const Graph &graph) {
+  std::vector<int> mark(graph.numVertices, 0);
+  std::vector<int> order;
+  order.reserve(graph.numVertices);
+  // Each connected component starts from a low-degree vertex.
+  for (int start : degree(graph)) {
+    if (mark[start] == 0) {
+      int root = pseudoPeripheral(graph, start, mark, 0);
+      size_t lastLevel;
+      breadthFirst(graph, root, mark, 0, VISITED, true, order, lastLevel);
+    }
+  }
+  std::reverse(order.begin(), order.end());
+  return order;
+}
+
+std::vector<int> Reordering::bisection(const Graph &graph) {
+  std::vector<int> order(graph.numVertices);
+  for (int v = 0; v < graph.numVertices; v++) {
+    order[v] = v;
+  }
+  std::vector<int> mark(graph.numVertices, 0);
+  std::vector<int> levelOrder;
+  std::vector< std::pair<int, int> > ranges;
+  ranges.push_back(std::make_pair(0, graph.numVertices));
+  int numParts = 0;
+  // Each range is put in breadth-first order from a peripheral vertex,
+  // so that its two halves are the near and the far side.
+  while (!ranges.empty()) {
+    int begin = ranges.back().first;
+    int end = ranges.back().second;
+    ranges.pop_back();
+    if (end - begin <= bisectionLeafSize) {
+      continue;
+    }
+    int part = ++numParts;
+    for (int k = begin; k < end; k++) {
+      mark[order[k]] = part;
+    }
+    levelOrder.clear();
+    for (int k = begin; k < end; k++) {
+      if (mark[order[k]] == part) {
+        int root = pseudoPeripheral(graph, order[k], mark, part);
+        size_t lastLevel;
+        breadthFirst(graph, root, mark, part, VISITED, false, levelOrder, lastLevel);
+      }
+    }
+    std::copy(levelOrder.begin(), levelOrder.end(), order.begin() + begin);
+    int mid = begin + (end - begin) / 2;
+    ranges.push_back(std::make_pair(begin, mid));
+    ranges.push_back(std::make_pair(mid, end));
+  }
+  return order;
+}
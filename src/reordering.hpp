@@ -0,0 +1,107 @@
+#pragma once
+
+#include "matrix.hpp"
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <limits>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  enum class Ordering { RCM, DEGREE, BISECTION };
+
+  // Symmetric orderings of square matrices that bring the elements closer
+  // to the diagonal, so that an SpMV row touches nearby elements of x.
+  // They work on the graph of A + A^T, i.e. the pattern symmetrized,
+  // without self loops and duplicate edges. A permutation perm lists the
+  // old row (column) indices in their new order: new row k is old row
+  // perm[k].
+  class Reordering {
+  public:
+    // Parts up to this size are not bisected further.
+    static const int bisectionLeafSize = 64;
+
+    // The vertices are numbered with int, so N must be below 2^31.
+    template<typename ValueType, typename IndexType>
+    static std::vector<int> compute(const CSRMatrix<ValueType, IndexType> &csr, Ordering ordering) {
+      if (csr.N != csr.M) {
+        std::cerr << "Only square matrices can be reordered.\n";
+        exit(1);
+      }
+      if (csr.N > (unsigned int)std::numeric_limits<int>::max()) {
+        std::cerr << "The matrix has too many rows to be reordered.\n";
+        exit(1);
+      }
+      Graph graph(csr.rowPtr, csr.colIndices, csr.N);
+      switch (ordering) {
+        case Ordering::DEGREE: return degree(graph);
+        case Ordering::BISECTION: return bisection(graph);
+        default: return reverseCuthillMcKee(graph);
+      }
+    }
+
+    // max |i - j| over the elements (i, j).
+    template<typename ValueType, typename IndexType>
+    static long bandwidth(const CSRMatrix<ValueType, IndexType> &csr) {
+      long result = 0;
+      for (unsigned int i = 0; i < csr.N; i++) {
+        for (IndexType k = csr.rowPtr[i]; k < csr.rowPtr[i + 1]; k++) {
+          result = std::max(result, std::labs((long)i - csr.colIndices[k]));
+        }
+      }
+      return result;
+    }
+
+    // The sum over the rows i of i - j, where j is the first column of
+    // row i with j <= i; rows without such an element add 0.
+    template<typename ValueType, typename IndexType>
+    static long profile(const CSRMatrix<ValueType, IndexType> &csr) {
+      long result = 0;
+      for (unsigned int i = 0; i < csr.N; i++) {
+        long first = i;
+        for (IndexType k = csr.rowPtr[i]; k < csr.rowPtr[i + 1]; k++) {
+          first = std::min(first, (long)csr.colIndices[k]);
+        }
+        result += i - first;
+      }
+      return result;
+    }
+
+  private:
+    // An undirected graph in compressed adjacency form. The offsets are
+    // long, as A + A^T may have twice as many edges as A has elements.
+    struct Graph {
+      int numVertices;
+      std::vector<long> ptr;
+      std::vector<int> adj;
+
+      Graph(const int *rowPtr, const int *colIndices, int N);
+      Graph(const long *rowPtr, const long *colIndices, int N);
+
+      int degree(int v) const {
+        return ptr[v + 1] - ptr[v];
+      }
+
+    private:
+      template<typename IndexType>
+      void build(const IndexType *rowPtr, const IndexType *colIndices);
+    };
+
+    // Appends the vertices reached from root to order, breadth-first,
+    // visiting the neighbors of each vertex by increasing degree if
+    // byDegree. Only vertices with mark[v] == part are visited; they are
+    // marked with visited. Returns the number of levels, and sets
+    // lastLevel to the position in order where the last level begins.
+    static int breadthFirst(const Graph &graph, int root, std::vector<int> &mark, int part, int visited,
+                            bool byDegree, std::vector<int> &order, size_t &lastLevel);
+
+    // A vertex of the part containing start that is far from the others,
+    // found by repeated breadth-first searches (George and Liu).
+    static int pseudoPeripheral(const Graph &graph, int start, std::vector<int> &mark, int part);
+
+    static std::vector<int> reverseCuthillMcKee(const Graph &graph);
+    static std::vector<int> degree(const Graph &graph);
+    static std::vector<int> bisection(const Graph &graph);
+  };
+}
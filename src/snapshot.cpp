@@ -0,0 +1,177 @@
+#include "snapshot.hpp"
+#include <stdio.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+using namespace thundercat;
+
+static const char SNAPSHOT_MAGIC[8] = { 'M', 'M', 'S', 'N', 'A', 'P', '\0', '\0' };
+static const uint32_t SNAPSHOT_VERSION = 2;
+static const uint64_t SECTION_ALIGNMENT = 64;
+
+// Returns 0 for unknown value types.
+static size_t valueSize(uint32_t valueType) {
+  switch (valueType) {
+    case SnapshotValueType<float>::code: return sizeof(float);
+    case SnapshotValueType<double>::code: return sizeof(double);
+    case SnapshotValueType< std::complex<float> >::code: return sizeof(std::complex<float>);
+    case SnapshotValueType< std::complex<double> >::code: return sizeof(std::complex<double>);
+    default: return 0;
+  }
+}
+
+static uint64_t alignUp(uint64_t offset) {
+  return (offset + SECTION_ALIGNMENT - 1) / SECTION_ALIGNMENT * SECTION_ALIGNMENT;
+}
+
+Snapshot::Snapshot(const SnapshotHeader &header, std::unique_ptr<MappedFile> file):
+  header(header), file(std::move(file)) { }
+
+SnapshotHeader Snapshot::makeHeader(SnapshotFormat format, uint32_t valueType, size_t valueSize,
+                                    size_t indexSize,
+                                    unsigned long N, unsigned long M, unsigned long NZ,
+                                    Symmetry symmetry, SnapshotOrder order, bool halfStored) {
+  SnapshotHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic));
+  header.version = SNAPSHOT_VERSION;
+  header.format = format;
+  header.valueType = valueType;
+  header.indexSize = indexSize;
+  header.symmetry = (uint32_t)symmetry;
+  header.order = order;
+  header.halfStored = halfStored;
+  header.N = N;
+  header.M = M;
+  header.NZ = NZ;
+
+  switch (format) {
+    case SnapshotFormat::COO:
+      header.sectionSizes[0] = NZ * indexSize;
+      header.sectionSizes[1] = NZ * indexSize;
+      break;
+    case SnapshotFormat::CSR:
+      header.sectionSizes[0] = (N + 1) * indexSize;
+      header.sectionSizes[1] = NZ * indexSize;
+      break;
+    case SnapshotFormat::CSC:
+      header.sectionSizes[0] = NZ * indexSize;
+      header.sectionSizes[1] = (M + 1) * indexSize;
+      break;
+  }
+  header.sectionSizes[2] = NZ * valueSize;
+
+  uint64_t offset = alignUp(sizeof(SnapshotHeader));
+  for (int i = 0; i < SnapshotHeader::NUM_SECTIONS; i++) {
+    header.sectionOffsets[i] = offset;
+    offset = alignUp(offset + header.sectionSizes[i]);
+  }
+  return header;
+}
+
+// FNV-1a applied to 64-bit words rather than bytes, which keeps
+// verification well below the cost of reading the file.
+uint64_t Snapshot::checksum(const void *sections[SnapshotHeader::NUM_SECTIONS],
+                            const uint64_t sizes[SnapshotHeader::NUM_SECTIONS]) {
+  const uint64_t prime = 0x100000001b3ULL;
+  uint64_t hash = 0xcbf29ce484222325ULL;
+  for (int i = 0; i < SnapshotHeader::NUM_SECTIONS; i++) {
+    const char *bytes = (const char*)sections[i];
+    uint64_t numWords = sizes[i] / sizeof(uint64_t);
+    for (uint64_t w = 0; w < numWords; w++) {
+      uint64_t word;
+      memcpy(&word, bytes + w * sizeof(uint64_t), sizeof(uint64_t));
+      hash = (hash ^ word) * prime;
+    }
+    uint64_t tail = 0;
+    memcpy(&tail, bytes + numWords * sizeof(uint64_t), sizes[i] % sizeof(uint64_t));
+    hash = (hash ^ tail) * prime;
+    hash = (hash ^ sizes[i]) * prime;
+  }
+  return hash;
+}
+
+bool Snapshot::write(std::string fileName, SnapshotHeader &header,
+                     const void *sections[SnapshotHeader::NUM_SECTIONS]) {
+  header.checksum = checksum(sections, header.sectionSizes);
+
+  // Write to a temporary file first, so that concurrent readers never
+  // see a partially written snapshot.
+  std::string tempFileName = fileName + ".tmp" + std::to_string(getpid());
+  FILE *f;
+  if ((f = fopen(tempFileName.c_str(), "wb")) == NULL) {
+    return false;
+  }
+
+  static const char padding[SECTION_ALIGNMENT] = { 0 };
+  bool ok = fwrite(&header, sizeof(header), 1, f) == 1;
+  uint64_t offset = sizeof(header);
+  for (int i = 0; i < SnapshotHeader::NUM_SECTIONS && ok; i++) {
+    ok = fwrite(padding, 1, header.sectionOffsets[i] - offset, f) == header.sectionOffsets[i] - offset;
+    ok = ok && fwrite(sections[i], 1, header.sectionSizes[i], f) == header.sectionSizes[i];
+    offset = header.sectionOffsets[i] + header.sectionSizes[i];
+  }
+  ok = (fclose(f) == 0) && ok;
+
+  if (!ok || rename(tempFileName.c_str(), fileName.c_str()) != 0) {
+    remove(tempFileName.c_str());
+    return false;
+  }
+  return true;
+}
+
+std::unique_ptr<Snapshot> Snapshot::open(std::string fileName, bool verify, bool copyOnWrite) {
+  auto file = MappedFile::open(fileName, copyOnWrite);
+  if (!file || file->size() < sizeof(SnapshotHeader)) {
+    return nullptr;
+  }
+
+  SnapshotHeader header;
+  memcpy(&header, file->begin(), sizeof(header));
+  if (memcmp(header.magic, SNAPSHOT_MAGIC, sizeof(header.magic)) != 0 ||
+      header.version != SNAPSHOT_VERSION ||
+      (header.indexSize != sizeof(int32_t) && header.indexSize != sizeof(int64_t)) ||
+      valueSize(header.valueType) == 0 ||
+      header.format > SnapshotFormat::CSC) {
+    return nullptr;
+  }
+
+  // The section layout must be the one implied by the dimensions.
+  SnapshotHeader expected = makeHeader(header.format, header.valueType, valueSize(header.valueType),
+                                       header.indexSize,
+                                       header.N, header.M, header.NZ,
+                                       (Symmetry)header.symmetry, header.order);
+  if (memcmp(expected.sectionOffsets, header.sectionOffsets, sizeof(header.sectionOffsets)) != 0 ||
+      memcmp(expected.sectionSizes, header.sectionSizes, sizeof(header.sectionSizes)) != 0) {
+    return nullptr;
+  }
+
+  const void *sections[SnapshotHeader::NUM_SECTIONS];
+  for (int i = 0; i < SnapshotHeader::NUM_SECTIONS; i++) {
+    if (header.sectionOffsets[i] > file->size() ||
+        header.sectionSizes[i] > file->size() - header.sectionOffsets[i]) {
+      return nullptr;
+    }
+    sections[i] = file->begin() + header.sectionOffsets[i];
+  }
+  if (verify && checksum(sections, header.sectionSizes) != header.checksum) {
+    return nullptr;
+  }
+
+  return std::unique_ptr<Snapshot>(new Snapshot(header, std::move(file)));
+}
+
+std::string Snapshot::cacheFileName(std::string matrixFileName) {
+  return matrixFileName + ".bin";
+}
+
+bool Snapshot::isNewer(std::string fileName, std::string otherFileName) {
+  struct stat info, otherInfo;
+  if (stat(fileName.c_str(), &info) != 0 || stat(otherFileName.c_str(), &otherInfo) != 0) {
+    return false;
+  }
+  if (info.st_mtim.tv_sec != otherInfo.st_mtim.tv_sec) {
+    return info.st_mtim.tv_sec > otherInfo.st_mtim.tv_sec;
+  }
+  return info.st_mtim.tv_nsec > otherInfo.st_mtim.tv_nsec;
+}
@@ -0,0 +1,236 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "mappedfile.hpp"
+#include "valuetraits.hpp"
+#include <stdint.h>
+#include <string.h>
+#include <complex>
+#include <memory>
+#include <string>
+
+namespace thundercat {
+  // Binary on-disk format for parsed matrices. The file consists of a
+  // SnapshotHeader followed by three raw arrays (sections), each starting
+  // at a 64-byte aligned offset:
+  //   COO: rowIndices[NZ], colIndices[NZ], values[NZ]
+  //   CSR: rowPtr[N + 1],  colIndices[NZ], values[NZ]
+  //   CSC: rowIndices[NZ], colPtr[M + 1],  values[NZ]
+  // Indices are 4 or 8 bytes, per the index type of the matrix written;
+  // arrays are stored in native byte order. Loading a snapshot involves
+  // no parsing; the sections are read from a mapping of the file.
+  enum class SnapshotFormat : uint32_t { COO = 0, CSR = 1, CSC = 2 };
+
+  // How the elements of a COO snapshot are ordered.
+  enum class SnapshotOrder : uint32_t { UNSORTED = 0, ROW_MAJOR = 1, COLUMN_MAJOR = 2 };
+
+  template<typename ValueType>
+  struct SnapshotValueType;
+
+  template<>
+  struct SnapshotValueType<float> { static const uint32_t code = 1; };
+
+  template<>
+  struct SnapshotValueType<double> { static const uint32_t code = 2; };
+
+  template<>
+  struct SnapshotValueType< std::complex<float> > { static const uint32_t code = 3; };
+
+  template<>
+  struct SnapshotValueType< std::complex<double> > { static const uint32_t code = 4; };
+
+  struct SnapshotHeader {
+    static const int NUM_SECTIONS = 3;
+
+    char magic[8];
+    uint32_t version;
+    SnapshotFormat format;
+    uint32_t valueType;
+    uint32_t indexSize;
+    // A Symmetry value.
+    uint32_t symmetry;
+    SnapshotOrder order;
+    // 1 if a COO snapshot of a symmetric, skew-symmetric or Hermitian
+    // matrix holds only the entries of its file (SymmetricStorage::HALF);
+    // otherwise the arrays hold the expanded matrix.
+    uint32_t halfStored;
+    uint64_t N;
+    uint64_t M;
+    uint64_t NZ;
+    // Hash of the section contents, see Snapshot::checksum.
+    uint64_t checksum;
+    uint64_t sectionOffsets[NUM_SECTIONS];
+    uint64_t sectionSizes[NUM_SECTIONS];
+  };
+
+  class Snapshot {
+  public:
+    const SnapshotHeader header;
+
+    // Maps a snapshot file. Returns nullptr if the file does not exist, is
+    // not a snapshot of this version, or (if verify) fails the checksum.
+    // See MappedFile::open for copyOnWrite.
+    static std::unique_ptr<Snapshot> open(std::string fileName, bool verify = true,
+                                          bool copyOnWrite = false);
+
+    // Writes the sections described by the header and fills in its offsets,
+    // sizes and checksum. The file is replaced atomically.
+    // Returns false if the file cannot be written.
+    static bool write(std::string fileName, SnapshotHeader &header,
+                      const void *sections[SnapshotHeader::NUM_SECTIONS]);
+
+    static SnapshotHeader makeHeader(SnapshotFormat format, uint32_t valueType, size_t valueSize,
+                                     size_t indexSize,
+                                     unsigned long N, unsigned long M, unsigned long NZ,
+                                     Symmetry symmetry, SnapshotOrder order, bool halfStored = false);
+
+    static uint64_t checksum(const void *sections[SnapshotHeader::NUM_SECTIONS],
+                             const uint64_t sizes[SnapshotHeader::NUM_SECTIONS]);
+
+    // The side-car cache file used for a .mtx file.
+    static std::string cacheFileName(std::string matrixFileName);
+
+    // True if both files exist and the first was modified after the second.
+    static bool isNewer(std::string fileName, std::string otherFileName);
+
+    const void *section(int i) const {
+      return file->begin() + header.sectionOffsets[i];
+    }
+
+    template<typename ValueType, typename IndexType = int>
+    bool holds(SnapshotFormat format) const {
+      return header.format == format &&
+        header.valueType == SnapshotValueType<ValueType>::code &&
+        header.indexSize == sizeof(IndexType);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static bool write(std::string fileName, const COOMatrix<ValueType, IndexType> &matrix,
+                      Symmetry symmetry = Symmetry::GENERAL,
+                      SnapshotOrder order = SnapshotOrder::ROW_MAJOR) {
+      SnapshotHeader header = makeHeader(SnapshotFormat::COO, SnapshotValueType<ValueType>::code,
+                                         sizeof(ValueType), sizeof(IndexType), matrix.N, matrix.M, matrix.NZ,
+                                         symmetry, order);
+      const void *sections[] = { matrix.rowIndices, matrix.colIndices, matrix.values };
+      return write(fileName, header, sections);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static bool write(std::string fileName, const CSRMatrix<ValueType, IndexType> &matrix,
+                      Symmetry symmetry = Symmetry::GENERAL) {
+      SnapshotHeader header = makeHeader(SnapshotFormat::CSR, SnapshotValueType<ValueType>::code,
+                                         sizeof(ValueType), sizeof(IndexType), matrix.N, matrix.M, matrix.NZ,
+                                         symmetry, SnapshotOrder::ROW_MAJOR);
+      const void *sections[] = { matrix.rowPtr, matrix.colIndices, matrix.values };
+      return write(fileName, header, sections);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static bool write(std::string fileName, const CSCMatrix<ValueType, IndexType> &matrix,
+                      Symmetry symmetry = Symmetry::GENERAL) {
+      SnapshotHeader header = makeHeader(SnapshotFormat::CSC, SnapshotValueType<ValueType>::code,
+                                         sizeof(ValueType), sizeof(IndexType), matrix.N, matrix.M, matrix.NZ,
+                                         symmetry, SnapshotOrder::COLUMN_MAJOR);
+      const void *sections[] = { matrix.rowIndices, matrix.colPtr, matrix.values };
+      return write(fileName, header, sections);
+    }
+
+    // The readers return nullptr if the file is missing, invalid,
+    // or holds a different format or value type, or a half-stored matrix.
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<COOMatrix<ValueType, IndexType>> readCOO(std::string fileName, bool verify = true) {
+      auto snapshot = open(fileName, verify);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::COO) || snapshot->header.halfStored)
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<COOMatrix<ValueType, IndexType>>(snapshot->copySection<IndexType>(0),
+                                                    snapshot->copySection<IndexType>(1),
+                                                    snapshot->copySection<ValueType>(2),
+                                                    h.N, h.M, h.NZ);
+    }
+
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<CSRMatrix<ValueType, IndexType>> readCSR(std::string fileName, bool verify = true) {
+      auto snapshot = open(fileName, verify);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::CSR))
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<CSRMatrix<ValueType, IndexType>>(snapshot->copySection<IndexType>(0),
+                                                    snapshot->copySection<IndexType>(1),
+                                                    snapshot->copySection<ValueType>(2),
+                                                    h.N, h.M, h.NZ);
+    }
+
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<CSCMatrix<ValueType, IndexType>> readCSC(std::string fileName, bool verify = true) {
+      auto snapshot = open(fileName, verify);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::CSC))
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<CSCMatrix<ValueType, IndexType>>(snapshot->copySection<IndexType>(0),
+                                                    snapshot->copySection<IndexType>(1),
+                                                    snapshot->copySection<ValueType>(2),
+                                                    h.N, h.M, h.NZ);
+    }
+
+    // The mappers return matrices whose arrays point into a copy-on-write
+    // mapping of the file, which stays mapped as long as the matrix lives.
+    // No data is copied, and processes that map the same snapshot share
+    // its pages through the page cache. The checksum is only verified if
+    // asked, as that reads the whole file.
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<COOMatrix<ValueType, IndexType>> mapCOO(std::string fileName, bool verify = false) {
+      auto snapshot = open(fileName, verify, true);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::COO) || snapshot->header.halfStored)
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<COOMatrix<ValueType, IndexType>>(snapshot->mappedSection<IndexType>(0),
+                                                    snapshot->mappedSection<IndexType>(1),
+                                                    snapshot->mappedSection<ValueType>(2),
+                                                    h.N, h.M, h.NZ, snapshot->file);
+    }
+
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<CSRMatrix<ValueType, IndexType>> mapCSR(std::string fileName, bool verify = false) {
+      auto snapshot = open(fileName, verify, true);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::CSR))
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<CSRMatrix<ValueType, IndexType>>(snapshot->mappedSection<IndexType>(0),
+                                                    snapshot->mappedSection<IndexType>(1),
+                                                    snapshot->mappedSection<ValueType>(2),
+                                                    h.N, h.M, h.NZ, snapshot->file);
+    }
+
+    template<typename ValueType, typename IndexType = int>
+    static std::unique_ptr<CSCMatrix<ValueType, IndexType>> mapCSC(std::string fileName, bool verify = false) {
+      auto snapshot = open(fileName, verify, true);
+      if (!snapshot || !snapshot->holds<ValueType, IndexType>(SnapshotFormat::CSC))
+        return nullptr;
+      const SnapshotHeader &h = snapshot->header;
+      return std::make_unique<CSCMatrix<ValueType, IndexType>>(snapshot->mappedSection<IndexType>(0),
+                                                    snapshot->mappedSection<IndexType>(1),
+                                                    snapshot->mappedSection<ValueType>(2),
+                                                    h.N, h.M, h.NZ, snapshot->file);
+    }
+
+  private:
+    std::shared_ptr<MappedFile> file;
+
+    Snapshot(const SnapshotHeader &header, std::unique_ptr<MappedFile> file);
+
+    // Only valid for copy-on-write mappings.
+    template<typename T>
+    T *mappedSection(int i) const {
+      return (T*)(file->writableBegin() + header.sectionOffsets[i]);
+    }
+
+    template<typename T>
+    T *copySection(int i) const {
+      size_t length = header.sectionSizes[i] / sizeof(T);
+      T *array = new T[length];
+      memcpy(array, section(i), header.sectionSizes[i]);
+      return array;
+    }
+  };
+}
@@ -0,0 +1,381 @@
+#include "spmv.hpp"
+#include <string.h>
+
+#if defined(__GNUC__) && defined(__x86_64__)
+#define SPMV_X86_KERNELS
+#include <immintrin.h>
+#endif
+
+using namespace thundercat;
+
+#ifdef SPMV_X86_KERNELS
+// The vector kernels are compiled for their instruction set regardless of
+// the compiler flags, and only called after checking the CPU.
+
+__attribute__((target("avx2,fma")))
+static void csrRowsAVX2(const int *rowPtr, const int *cols, const double *vals,
+                        const double *x, double *y, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    int k = rowPtr[i];
+    const int rowEnd = rowPtr[i + 1];
+    __m256d sums = _mm256_setzero_pd();
+    for (; k + 4 <= rowEnd; k += 4) {
+      __m128i indices = _mm_loadu_si128((const __m128i*)(cols + k));
+      __m256d xs = _mm256_i32gather_pd(x, indices, sizeof(double));
+      sums = _mm256_fmadd_pd(_mm256_loadu_pd(vals + k), xs, sums);
+    }
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sums), _mm256_extractf128_pd(sums, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; k < rowEnd; k++) {
+      sum += vals[k] * x[cols[k]];
+    }
+    y[i] = sum;
+  }
+}
+
+__attribute__((target("avx2,fma")))
+static void csrRowsAVX2(const int *rowPtr, const int *cols, const float *vals,
+                        const float *x, float *y, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    int k = rowPtr[i];
+    const int rowEnd = rowPtr[i + 1];
+    __m256 sums = _mm256_setzero_ps();
+    for (; k + 8 <= rowEnd; k += 8) {
+      __m256i indices = _mm256_loadu_si256((const __m256i*)(cols + k));
+      __m256 xs = _mm256_i32gather_ps(x, indices, sizeof(float));
+      sums = _mm256_fmadd_ps(_mm256_loadu_ps(vals + k), xs, sums);
+    }
+    __m128 half = _mm_add_ps(_mm256_castps256_ps128(sums), _mm256_extractf128_ps(sums, 1));
+    half = _mm_add_ps(half, _mm_movehl_ps(half, half));
+    float sum = _mm_cvtss_f32(_mm_add_ss(half, _mm_shuffle_ps(half, half, 1)));
+    for (; k < rowEnd; k++) {
+      sum += vals[k] * x[cols[k]];
+    }
+    y[i] = sum;
+  }
+}
+
+__attribute__((target("avx512f")))
+static void csrRowsAVX512(const int *rowPtr, const int *cols, const double *vals,
+                          const double *x, double *y, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    int k = rowPtr[i];
+    const int rowEnd = rowPtr[i + 1];
+    __m512d sums = _mm512_setzero_pd();
+    for (; k + 8 <= rowEnd; k += 8) {
+      __m256i indices = _mm256_loadu_si256((const __m256i*)(cols + k));
+      __m512d xs = _mm512_i32gather_pd(indices, x, sizeof(double));
+      sums = _mm512_fmadd_pd(_mm512_loadu_pd(vals + k), xs, sums);
+    }
+    double sum = _mm512_reduce_add_pd(sums);
+    for (; k < rowEnd; k++) {
+      sum += vals[k] * x[cols[k]];
+    }
+    y[i] = sum;
+  }
+}
+
+__attribute__((target("avx512f")))
+static void csrRowsAVX512(const int *rowPtr, const int *cols, const float *vals,
+                          const float *x, float *y, size_t begin, size_t end) {
+  for (size_t i = begin; i < end; i++) {
+    int k = rowPtr[i];
+    const int rowEnd = rowPtr[i + 1];
+    __m512 sums = _mm512_setzero_ps();
+    for (; k + 16 <= rowEnd; k += 16) {
+      __m512i indices = _mm512_loadu_si512((const void*)(cols + k));
+      __m512 xs = _mm512_i32gather_ps(indices, x, sizeof(float));
+      sums = _mm512_fmadd_ps(_mm512_loadu_ps(vals + k), xs, sums);
+    }
+    float sum = _mm512_reduce_add_ps(sums);
+    for (; k < rowEnd; k++) {
+      sum += vals[k] * x[cols[k]];
+    }
+    y[i] = sum;
+  }
+}
+
+// The next four columns after the last one in cols: a prefix sum of 1-
+// and 2-byte deltas, or the 4-byte columns themselves.
+template<typename Delta>
+__attribute__((target("avx2,fma")))
+static inline __m128i nextColumns(__m128i cols, const Delta *deltas);
+
+template<>
+__attribute__((target("avx2,fma")))
+inline __m128i nextColumns<int32_t>(__m128i, const int32_t *deltas) {
+  return _mm_loadu_si128((const __m128i*)deltas);
+}
+
+__attribute__((target("avx2,fma")))
+static inline __m128i prefixColumns(__m128i cols, __m128i deltas) {
+  deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 4));
+  deltas = _mm_add_epi32(deltas, _mm_slli_si128(deltas, 8));
+  return _mm_add_epi32(_mm_shuffle_epi32(cols, 0xFF), deltas);
+}
+
+template<>
+__attribute__((target("avx2,fma")))
+inline __m128i nextColumns<uint8_t>(__m128i cols, const uint8_t *deltas) {
+  int32_t bytes;
+  memcpy(&bytes, deltas, sizeof(bytes));
+  return prefixColumns(cols, _mm_cvtepu8_epi32(_mm_cvtsi32_si128(bytes)));
+}
+
+template<>
+__attribute__((target("avx2,fma")))
+inline __m128i nextColumns<uint16_t>(__m128i cols, const uint16_t *deltas) {
+  return prefixColumns(cols, _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)deltas)));
+}
+
+template<typename Delta>
+__attribute__((target("avx2,fma")))
+static void deltaCSRBlockAVX2(const DeltaCSRMatrix<double> &A, unsigned int block, const double *x, double *y) {
+  const Delta *deltas = (const Delta*)(A.deltas + A.blockOffsets[block]);
+  const double *vals = A.values;
+  const unsigned int rowEnd = std::min(A.N, (block + 1) * A.blockSize);
+  for (unsigned int i = block * A.blockSize; i < rowEnd; i++) {
+    int k = A.rowPtr[i];
+    const int end = A.rowPtr[i + 1];
+    if (k == end) {
+      y[i] = 0;
+      continue;
+    }
+    int col = A.firstCols[i];
+    double sum = vals[k] * x[col];
+    k++;
+    if (end - k >= 4) {
+      __m128i cols = _mm_set1_epi32(col);
+      __m256d sums = _mm256_setzero_pd();
+      for (; k + 4 <= end; k += 4, deltas += 4) {
+        cols = nextColumns<Delta>(cols, deltas);
+        sums = _mm256_fmadd_pd(_mm256_loadu_pd(vals + k), _mm256_i32gather_pd(x, cols, sizeof(double)), sums);
+      }
+      __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sums), _mm256_extractf128_pd(sums, 1));
+      sum += _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+      col = _mm_extract_epi32(cols, 3);
+    }
+    for (; k < end; k++) {
+      col = spmvkernels::nextColumn(col, *deltas++);
+      sum += vals[k] * x[col];
+    }
+    y[i] = sum;
+  }
+}
+
+template<typename Delta>
+__attribute__((target("avx2,fma")))
+static void deltaCSRBlockAVX2(const DeltaCSRMatrix<float> &A, unsigned int block, const float *x, float *y) {
+  const Delta *deltas = (const Delta*)(A.deltas + A.blockOffsets[block]);
+  const float *vals = A.values;
+  const unsigned int rowEnd = std::min(A.N, (block + 1) * A.blockSize);
+  for (unsigned int i = block * A.blockSize; i < rowEnd; i++) {
+    int k = A.rowPtr[i];
+    const int end = A.rowPtr[i + 1];
+    if (k == end) {
+      y[i] = 0;
+      continue;
+    }
+    int col = A.firstCols[i];
+    float sum = vals[k] * x[col];
+    k++;
+    if (end - k >= 4) {
+      __m128i cols = _mm_set1_epi32(col);
+      __m128 sums = _mm_setzero_ps();
+      for (; k + 4 <= end; k += 4, deltas += 4) {
+        cols = nextColumns<Delta>(cols, deltas);
+        sums = _mm_fmadd_ps(_mm_loadu_ps(vals + k), _mm_i32gather_ps(x, cols, sizeof(float)), sums);
+      }
+      sums = _mm_add_ps(sums, _mm_movehl_ps(sums, sums));
+      sum += _mm_cvtss_f32(_mm_add_ss(sums, _mm_shuffle_ps(sums, sums, 1)));
+      col = _mm_extract_epi32(cols, 3);
+    }
+    for (; k < end; k++) {
+      col = spmvkernels::nextColumn(col, *deltas++);
+      sum += vals[k] * x[col];
+    }
+    y[i] = sum;
+  }
+}
+
+// Four 16-bit values widened to float: with F16C for float16, and by
+// shifting them into the high half for bfloat16.
+template<typename StoredType>
+static __m128 widenValues(const StoredType *vals);
+
+template<>
+__attribute__((target("avx2,fma,f16c")))
+__m128 widenValues<float16>(const float16 *vals) {
+  return _mm_cvtph_ps(_mm_loadl_epi64((const __m128i*)vals));
+}
+
+template<>
+__attribute__((target("avx2,fma,f16c")))
+__m128 widenValues<bfloat16>(const bfloat16 *vals) {
+  __m128i bits = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*)vals));
+  return _mm_castsi128_ps(_mm_slli_epi32(bits, 16));
+}
+
+template<typename StoredType>
+__attribute__((target("avx2,fma,f16c")))
+static void csrRowsWidenedAVX2(const CSRMatrix<StoredType> &A, const double *x, double *y, size_t begin, size_t end) {
+  const int *rowPtr = A.rowPtr;
+  const int *cols = A.colIndices;
+  const StoredType *vals = A.values;
+  for (size_t i = begin; i < end; i++) {
+    int k = rowPtr[i];
+    const int rowEnd = rowPtr[i + 1];
+    __m256d sums = _mm256_setzero_pd();
+    for (; k + 4 <= rowEnd; k += 4) {
+      __m128i indices = _mm_loadu_si128((const __m128i*)(cols + k));
+      __m256d xs = _mm256_i32gather_pd(x, indices, sizeof(double));
+      sums = _mm256_fmadd_pd(_mm256_cvtps_pd(widenValues(vals + k)), xs, sums);
+    }
+    __m128d half = _mm_add_pd(_mm256_castpd256_pd128(sums), _mm256_extractf128_pd(sums, 1));
+    double sum = _mm_cvtsd_f64(_mm_add_sd(half, _mm_unpackhi_pd(half, half)));
+    for (; k < rowEnd; k++) {
+      sum += (double)vals[k] * x[cols[k]];
+    }
+    y[i] = sum;
+  }
+}
+#endif
+
+static bool isSupported(SpMVKernel kernel) {
+  switch (kernel) {
+#ifdef SPMV_X86_KERNELS
+    case SpMVKernel::AVX2:
+      return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma");
+    case SpMVKernel::AVX512:
+      return __builtin_cpu_supports("avx512f");
+#else
+    case SpMVKernel::AVX2:
+    case SpMVKernel::AVX512:
+      return false;
+#endif
+    default:
+      return true;
+  }
+}
+
+static SpMVKernel &selectedKernel() {
+  static SpMVKernel kernel = isSupported(SpMVKernel::AVX512) ? SpMVKernel::AVX512 :
+                             isSupported(SpMVKernel::AVX2) ? SpMVKernel::AVX2 : SpMVKernel::SCALAR;
+  return kernel;
+}
+
+SpMVKernel thundercat::getSpMVKernel(SpMVFormat format) {
+  return format == SpMVFormat::CSR ? selectedKernel() : SpMVKernel::SCALAR;
+}
+
+bool thundercat::setSpMVKernel(SpMVKernel kernel, SpMVFormat format) {
+  if (format != SpMVFormat::CSR) {
+    return kernel == SpMVKernel::SCALAR;
+  }
+  if (!isSupported(kernel)) {
+    return false;
+  }
+  selectedKernel() = kernel;
+  return true;
+}
+
+static DeltaCSRDecoding &deltaCSRDecoding() {
+  static DeltaCSRDecoding decoding = DeltaCSRDecoding::AUTO;
+  return decoding;
+}
+
+DeltaCSRDecoding thundercat::getDeltaCSRDecoding() {
+  return deltaCSRDecoding();
+}
+
+void thundercat::setDeltaCSRDecoding(DeltaCSRDecoding decoding) {
+  deltaCSRDecoding() = decoding;
+}
+
+template<typename ValueType>
+static void dispatchCSRRows(const CSRMatrix<ValueType> &A, const ValueType *x, ValueType *y,
+                            size_t begin, size_t end) {
+  switch (selectedKernel()) {
+#ifdef SPMV_X86_KERNELS
+    case SpMVKernel::AVX512:
+      csrRowsAVX512(A.rowPtr, A.colIndices, A.values, x, y, begin, end);
+      break;
+    case SpMVKernel::AVX2:
+      csrRowsAVX2(A.rowPtr, A.colIndices, A.values, x, y, begin, end);
+      break;
+#endif
+    default:
+      spmvkernels::csrRows<ValueType>(A, x, y, begin, end);
+      break;
+  }
+}
+
+void thundercat::spmvkernels::csrRows(const CSRMatrix<double> &A, const double *x, double *y, size_t begin, size_t end) {
+  dispatchCSRRows(A, x, y, begin, end);
+}
+
+void thundercat::spmvkernels::csrRows(const CSRMatrix<float> &A, const float *x, float *y, size_t begin, size_t end) {
+  dispatchCSRRows(A, x, y, begin, end);
+}
+
+// The AVX2 kernel also serves when AVX-512 is selected; decoding four
+// columns at a time fits the 128-bit index vectors of the gathers.
+template<typename ValueType>
+static void dispatchDeltaCSRBlocks(const DeltaCSRMatrix<ValueType> &A, const ValueType *x, ValueType *y,
+                                   size_t begin, size_t end) {
+#ifdef SPMV_X86_KERNELS
+  const DeltaCSRDecoding decoding = deltaCSRDecoding();
+  if (decoding != DeltaCSRDecoding::SCALAR && selectedKernel() != SpMVKernel::SCALAR &&
+      isSupported(SpMVKernel::AVX2)) {
+    for (size_t block = begin; block < end; block++) {
+      const size_t rowBegin = block * A.blockSize;
+      const size_t rowEnd = std::min((size_t)A.N, rowBegin + A.blockSize);
+      if (decoding == DeltaCSRDecoding::AUTO &&
+          (size_t)(A.rowPtr[rowEnd] - A.rowPtr[rowBegin]) < deltaCSRVectorRowLength * (rowEnd - rowBegin)) {
+        spmvkernels::deltaCSRBlocks<ValueType>(A, x, y, block, block + 1);
+        continue;
+      }
+      switch (A.blockWidths[block]) {
+        case 1: deltaCSRBlockAVX2<uint8_t>(A, block, x, y); break;
+        case 2: deltaCSRBlockAVX2<uint16_t>(A, block, x, y); break;
+        default: deltaCSRBlockAVX2<int32_t>(A, block, x, y); break;
+      }
+    }
+    return;
+  }
+#endif
+  spmvkernels::deltaCSRBlocks<ValueType>(A, x, y, begin, end);
+}
+
+void thundercat::spmvkernels::deltaCSRBlocks(const DeltaCSRMatrix<double> &A, const double *x, double *y,
+                                             size_t begin, size_t end) {
+  dispatchDeltaCSRBlocks(A, x, y, begin, end);
+}
+
+void thundercat::spmvkernels::deltaCSRBlocks(const DeltaCSRMatrix<float> &A, const float *x, float *y,
+                                             size_t begin, size_t end) {
+  dispatchDeltaCSRBlocks(A, x, y, begin, end);
+}
+
+// As for DeltaCSR, the AVX2 kernel also serves when AVX-512 is selected.
+template<typename StoredType>
+static void dispatchCSRRowsWidened(const CSRMatrix<StoredType> &A, const double *x, double *y,
+                                   size_t begin, size_t end) {
+#ifdef SPMV_X86_KERNELS
+  if (selectedKernel() != SpMVKernel::SCALAR && isSupported(SpMVKernel::AVX2) && __builtin_cpu_supports("f16c")) {
+    csrRowsWidenedAVX2(A, x, y, begin, end);
+    return;
+  }
+#endif
+  spmvkernels::csrRowsWidened<StoredType, int, double>(A, x, y, begin, end);
+}
+
+void thundercat::spmvkernels::csrRowsWidened(const CSRMatrix<float16> &A, const double *x, double *y,
+                                             size_t begin, size_t end) {
+  dispatchCSRRowsWidened(A, x, y, begin, end);
+}
+
+void thundercat::spmvkernels::csrRowsWidened(const CSRMatrix<bfloat16> &A, const double *x, double *y,
+                                             size_t begin, size_t end) {
+  dispatchCSRRowsWidened(A, x, y, begin, end);
+}
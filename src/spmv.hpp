@@ -0,0 +1,524 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+#include "precision.hpp"
+#include "valuetraits.hpp"
+#include <stdint.h>
+#include <algorithm>
+#include <memory>
+#include <utility>
+
+namespace thundercat {
+  // The instruction sets the CSR kernels for float and double values with
+  // int indices can use.
+  // The widest one the CPU supports is picked at runtime; the vector
+  // kernels gather x through the column indices of each row. They sum the
+  // products of a row in a different order than the scalar kernel, so
+  // results may differ in the last bits.
+  enum class SpMVKernel { SCALAR, AVX2, AVX512 };
+
+  // The formats of the kernel selection. Only CSR has vector kernels: COO
+  // and CSC add each product into y at a row that the next products may
+  // share, so gathering x would save nothing there.
+  enum class SpMVFormat { COO, CSR, CSC };
+
+  // The kernel used for float and double matrices of the format.
+  SpMVKernel getSpMVKernel(SpMVFormat format = SpMVFormat::CSR);
+
+  // Selects the kernel for float and double CSR matrices, e.g. to compare
+  // them. Returns false, leaving the selection unchanged, if the CPU does
+  // not support it, or if the format has no such kernel; COO and CSC
+  // only have SCALAR. Must not be called while an SpMV is running.
+  bool setSpMVKernel(SpMVKernel kernel, SpMVFormat format = SpMVFormat::CSR);
+
+  // How DeltaCSR columns are decoded when the selected kernel is not
+  // SCALAR. The AVX2 decoder, which decodes four columns at a time,
+  // measured 10-20% faster than the scalar one on rows of 32 or more
+  // elements, but up to 60% slower on rows of 4 to 8. AUTO, the default,
+  // uses it for the blocks whose rows have at least
+  // deltaCSRVectorRowLength elements on average; VECTOR uses it for all
+  // blocks, e.g. to test it. Must not be changed while an SpMV is running.
+  enum class DeltaCSRDecoding { SCALAR, VECTOR, AUTO };
+  const unsigned int deltaCSRVectorRowLength = 24;
+
+  DeltaCSRDecoding getDeltaCSRDecoding();
+  void setDeltaCSRDecoding(DeltaCSRDecoding decoding);
+
+  namespace spmvkernels {
+    // y_i = sum_k a_ik * x_k for rows [begin, end) of a CSR matrix.
+    template<typename ValueType, typename IndexType>
+    void csrRows(const CSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y, size_t begin, size_t end) {
+      const IndexType *rowPtr = A.rowPtr;
+      const IndexType *cols = A.colIndices;
+      const ValueType *vals = A.values;
+      for (size_t i = begin; i < end; i++) {
+        ValueType sum = 0;
+        for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+          sum += vals[k] * x[cols[k]];
+        }
+        y[i] = sum;
+      }
+    }
+
+    // Dispatch to the selected SpMVKernel. Matrices with long indices
+    // take the scalar template above.
+    void csrRows(const CSRMatrix<double> &A, const double *x, double *y, size_t begin, size_t end);
+    void csrRows(const CSRMatrix<float> &A, const float *x, float *y, size_t begin, size_t end);
+
+    // Like csrRows, for values stored in another (narrower) type than x and
+    // y: each value is widened, and the products are summed in double.
+    template<typename StoredType, typename IndexType, typename ValueType>
+    void csrRowsWidened(const CSRMatrix<StoredType, IndexType> &A, const ValueType *x, ValueType *y,
+                        size_t begin, size_t end) {
+      const IndexType *rowPtr = A.rowPtr;
+      const IndexType *cols = A.colIndices;
+      const StoredType *vals = A.values;
+      for (size_t i = begin; i < end; i++) {
+        double sum = 0;
+        for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+          sum += (double)vals[k] * x[cols[k]];
+        }
+        y[i] = sum;
+      }
+    }
+
+    // Dispatch to an AVX2 kernel when the selected SpMVKernel is not SCALAR
+    // and the CPU supports F16C.
+    void csrRowsWidened(const CSRMatrix<float16> &A, const double *x, double *y, size_t begin, size_t end);
+    void csrRowsWidened(const CSRMatrix<bfloat16> &A, const double *x, double *y, size_t begin, size_t end);
+
+    // y_i = sum_k x_k over the columns k of rows [begin, end).
+    template<typename IndexType, typename ValueType>
+    void patternRows(const PatternCSRMatrix<IndexType> &A, const ValueType *x, ValueType *y, size_t begin, size_t end) {
+      const IndexType *rowPtr = A.rowPtr;
+      const IndexType *cols = A.colIndices;
+      for (size_t i = begin; i < end; i++) {
+        ValueType sum = 0;
+        for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+          sum += x[cols[k]];
+        }
+        y[i] = sum;
+      }
+    }
+
+    // y_i += a_ij * x_j for columns [begin, end) of a CSC matrix.
+    template<typename ValueType, typename IndexType>
+    void cscColumns(const CSCMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y, size_t begin, size_t end) {
+      const IndexType *colPtr = A.colPtr;
+      const IndexType *rows = A.rowIndices;
+      const ValueType *vals = A.values;
+      for (size_t j = begin; j < end; j++) {
+        const ValueType xj = x[j];
+        for (IndexType k = colPtr[j]; k < colPtr[j + 1]; k++) {
+          y[rows[k]] += vals[k] * xj;
+        }
+      }
+    }
+
+    // y_i += a_ij * x_j for elements [begin, end) of a COO matrix.
+    template<typename ValueType, typename IndexType>
+    void cooElements(const COOMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y, long begin, long end) {
+      const IndexType *rows = A.rowIndices;
+      const IndexType *cols = A.colIndices;
+      const ValueType *vals = A.values;
+      for (long k = begin; k < end; k++) {
+        y[rows[k]] += vals[k] * x[cols[k]];
+      }
+    }
+
+    // y = A * x for chunks [begin, end) of a SELL-C-sigma matrix. The
+    // loops over the C lanes of a chunk are independent, so that the
+    // compiler can vectorize them. Padding is multiplied like elements,
+    // which differs from CSR only for non-finite x (see SELLMatrix).
+    template<typename ValueType, typename IndexType>
+    void sellChunks(const SELLMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    size_t begin, size_t end) {
+      const unsigned int C = A.C;
+      std::unique_ptr<ValueType[]> sums(new ValueType[C]);
+      for (size_t chunk = begin; chunk < end; chunk++) {
+        for (unsigned int lane = 0; lane < C; lane++) {
+          sums[lane] = 0;
+        }
+        const int length = A.chunkLength(chunk);
+        for (int j = 0; j < length; j++) {
+          const IndexType *cols = A.colIndices + A.chunkPtr[chunk] + (long)j * C;
+          const ValueType *vals = A.values + A.chunkPtr[chunk] + (long)j * C;
+          for (unsigned int lane = 0; lane < C; lane++) {
+            sums[lane] += vals[lane] * x[cols[lane]];
+          }
+        }
+        for (unsigned int lane = 0; lane < C && chunk * C + lane < A.N; lane++) {
+          y[A.rowPerm[chunk * C + lane]] = sums[lane];
+        }
+      }
+    }
+
+    // y = A * x for block rows [begin, end) of a BCSR matrix, with the
+    // block size given at compile time so that the block loops unroll.
+    // Blocks that stick out of the last block column are done in full
+    // only if they do not read past the end of x.
+    template<int R, int C, typename ValueType, typename IndexType>
+    void bcsrBlockRows(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                       size_t begin, size_t end) {
+      for (size_t blockRow = begin; blockRow < end; blockRow++) {
+        ValueType sums[R];
+        for (int i = 0; i < R; i++) {
+          sums[i] = 0;
+        }
+        for (IndexType k = A.blockRowPtr[blockRow]; k < A.blockRowPtr[blockRow + 1]; k++) {
+          const ValueType *block = A.values + (long)k * R * C;
+          const size_t col = (size_t)A.blockColIndices[k] * C;
+          const ValueType *xs = x + col;
+          if (col + C <= A.M) {
+            ValueType xBlock[C];
+            for (int j = 0; j < C; j++) {
+              xBlock[j] = xs[j];
+            }
+            for (int i = 0; i < R; i++) {
+              for (int j = 0; j < C; j++) {
+                sums[i] += block[i * C + j] * xBlock[j];
+              }
+            }
+          } else {
+            for (int i = 0; i < R; i++) {
+              for (int j = 0; col + j < A.M; j++) {
+                sums[i] += block[i * C + j] * xs[j];
+              }
+            }
+          }
+        }
+        for (int i = 0; i < R && blockRow * R + i < A.N; i++) {
+          y[blockRow * R + i] = sums[i];
+        }
+      }
+    }
+
+    // The same, for any block size.
+    template<typename ValueType, typename IndexType>
+    void bcsrBlockRows(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                       size_t begin, size_t end) {
+      const int R = A.r;
+      const int C = A.c;
+      std::unique_ptr<ValueType[]> sums(new ValueType[R]);
+      for (size_t blockRow = begin; blockRow < end; blockRow++) {
+        for (int i = 0; i < R; i++) {
+          sums[i] = 0;
+        }
+        for (IndexType k = A.blockRowPtr[blockRow]; k < A.blockRowPtr[blockRow + 1]; k++) {
+          const ValueType *block = A.values + (long)k * R * C;
+          const size_t col = (size_t)A.blockColIndices[k] * C;
+          const int width = std::min((size_t)C, A.M - col);
+          for (int i = 0; i < R; i++) {
+            for (int j = 0; j < width; j++) {
+              sums[i] += block[i * C + j] * x[col + j];
+            }
+          }
+        }
+        for (int i = 0; i < R && blockRow * R + i < A.N; i++) {
+          y[blockRow * R + i] = sums[i];
+        }
+      }
+    }
+
+    template<int R, typename ValueType, typename IndexType>
+    void bcsrDispatchWidth(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                           size_t begin, size_t end) {
+      switch (A.c) {
+        case 1: bcsrBlockRows<R, 1>(A, x, y, begin, end); break;
+        case 2: bcsrBlockRows<R, 2>(A, x, y, begin, end); break;
+        case 3: bcsrBlockRows<R, 3>(A, x, y, begin, end); break;
+        case 4: bcsrBlockRows<R, 4>(A, x, y, begin, end); break;
+        case 5: bcsrBlockRows<R, 5>(A, x, y, begin, end); break;
+        case 6: bcsrBlockRows<R, 6>(A, x, y, begin, end); break;
+        case 7: bcsrBlockRows<R, 7>(A, x, y, begin, end); break;
+        case 8: bcsrBlockRows<R, 8>(A, x, y, begin, end); break;
+        default: bcsrBlockRows(A, x, y, begin, end); break;
+      }
+    }
+
+    // Picks the unrolled kernel for blocks up to 8 x 8.
+    template<typename ValueType, typename IndexType>
+    void bcsrDispatch(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                      size_t begin, size_t end) {
+      switch (A.r) {
+        case 1: bcsrDispatchWidth<1>(A, x, y, begin, end); break;
+        case 2: bcsrDispatchWidth<2>(A, x, y, begin, end); break;
+        case 3: bcsrDispatchWidth<3>(A, x, y, begin, end); break;
+        case 4: bcsrDispatchWidth<4>(A, x, y, begin, end); break;
+        case 5: bcsrDispatchWidth<5>(A, x, y, begin, end); break;
+        case 6: bcsrDispatchWidth<6>(A, x, y, begin, end); break;
+        case 7: bcsrDispatchWidth<7>(A, x, y, begin, end); break;
+        case 8: bcsrDispatchWidth<8>(A, x, y, begin, end); break;
+        default: bcsrBlockRows(A, x, y, begin, end); break;
+      }
+    }
+
+    // The column after col in a DeltaCSR row: 1- and 2-byte deltas are
+    // added to it, and 4-byte ones are the column itself.
+    inline long nextColumn(long col, uint8_t delta) {
+      return col + delta;
+    }
+
+    inline long nextColumn(long col, uint16_t delta) {
+      return col + delta;
+    }
+
+    inline long nextColumn(long, int32_t column) {
+      return column;
+    }
+
+    // y = A * x for the rows of a block of a DeltaCSR matrix whose deltas
+    // are of type Delta; the columns are decoded as the row is summed.
+    template<typename Delta, typename ValueType, typename IndexType>
+    void deltaCSRBlock(const DeltaCSRMatrix<ValueType, IndexType> &A, unsigned int block,
+                       const ValueType *x, ValueType *y) {
+      const Delta *deltas = (const Delta*)(A.deltas + A.blockOffsets[block]);
+      const ValueType *vals = A.values;
+      const unsigned int rowEnd = std::min(A.N, (block + 1) * A.blockSize);
+      for (unsigned int i = block * A.blockSize; i < rowEnd; i++) {
+        IndexType k = A.rowPtr[i];
+        const IndexType end = A.rowPtr[i + 1];
+        ValueType sum = 0;
+        if (k < end) {
+          long col = A.firstCols[i];
+          sum = vals[k] * x[col];
+          for (k++; k < end; k++) {
+            col = nextColumn(col, *deltas++);
+            sum += vals[k] * x[col];
+          }
+        }
+        y[i] = sum;
+      }
+    }
+
+    // y = A * x for blocks [begin, end) of a DeltaCSR matrix.
+    template<typename ValueType, typename IndexType>
+    void deltaCSRBlocks(const DeltaCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                        size_t begin, size_t end) {
+      for (size_t block = begin; block < end; block++) {
+        switch (A.blockWidths[block]) {
+          case 1: deltaCSRBlock<uint8_t>(A, block, x, y); break;
+          case 2: deltaCSRBlock<uint16_t>(A, block, x, y); break;
+          default: deltaCSRBlock<int32_t>(A, block, x, y); break;
+        }
+      }
+    }
+
+    // Dispatch each block to the scalar kernel, or as DeltaCSRDecoding
+    // selects, to the AVX2 kernel, which decodes four columns at a time
+    // and gathers x with them.
+    void deltaCSRBlocks(const DeltaCSRMatrix<double> &A, const double *x, double *y, size_t begin, size_t end);
+    void deltaCSRBlocks(const DeltaCSRMatrix<float> &A, const float *x, float *y, size_t begin, size_t end);
+
+    // Runs scatter(t, yPart) on numThreads threads, where each thread
+    // accumulates into its own copy of y (thread 0 into y itself), and
+    // then adds up the copies. This costs O(N * numThreads) extra memory,
+    // but needs no atomics.
+    template<typename ValueType, typename Scatter>
+    void scatterParallel(unsigned int N, ValueType *y, unsigned int numThreads, Scatter scatter) {
+      numThreads = std::max(1u, numThreads);
+      std::unique_ptr<ValueType[]> partials(new ValueType[(size_t)N * (numThreads - 1)]);
+      runParallel(numThreads, [&](unsigned int t) {
+        ValueType *yPart = t == 0 ? y : partials.get() + (size_t)N * (t - 1);
+        for (unsigned int i = 0; i < N; i++) {
+          yPart[i] = 0;
+        }
+        scatter(t, yPart);
+      });
+      runParallel(numThreads, [&](unsigned int t) {
+        const unsigned int begin = (unsigned long)N * t / numThreads;
+        const unsigned int end = (unsigned long)N * (t + 1) / numThreads;
+        for (unsigned int p = 0; p < numThreads - 1; p++) {
+          const ValueType *yPart = partials.get() + (size_t)N * p;
+          for (unsigned int i = begin; i < end; i++) {
+            y[i] += yPart[i];
+          }
+        }
+      });
+    }
+
+    // The kernel of spmvSymmetric; mirror maps a_ij to a_ji.
+    template<typename ValueType, typename IndexType, typename Mirror>
+    void spmvHalf(const CSRMatrix<ValueType, IndexType> &lower, const ValueType *x, ValueType *y, Mirror mirror) {
+      const IndexType *rowPtr = lower.rowPtr;
+      const IndexType *cols = lower.colIndices;
+      const ValueType *vals = lower.values;
+      for (size_t i = 0; i < lower.N; i++) {
+        y[i] = 0;
+      }
+      for (size_t i = 0; i < lower.N; i++) {
+        ValueType sum = 0;
+        const ValueType xi = x[i];
+        for (IndexType k = rowPtr[i]; k < rowPtr[i + 1]; k++) {
+          const IndexType j = cols[k];
+          sum += vals[k] * x[j];
+          if ((size_t)j != i) {
+            y[j] += mirror(vals[k]) * xi;
+          }
+        }
+        y[i] += sum;
+      }
+    }
+  }
+
+  // y = A * x, where x has A.M and y has A.N elements.
+  // The spmvParallel variants split the work among numThreads threads so
+  // that each gets about the same number of elements. For CSR (also with
+  // narrower or no values), SELL, BCSR and DeltaCSR, each thread computes
+  // a range of rows (chunks, blocks) of y;
+  // for CSC and COO, whose elements of a row are spread out, each thread
+  // sums into a private copy of y. A numThreads of 0 counts as 1.
+  template<typename ValueType, typename IndexType>
+  void spmv(const CSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::csrRows(A, x, y, 0, A.N);
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const CSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.rowPtr, A.N, t, numThreads);
+      spmvkernels::csrRows(A, x, y, range.first, range.second);
+    });
+  }
+
+  // For a CSR matrix whose values are stored in another type than x and y,
+  // e.g. float16 or bfloat16 (see Precision), or float with double vectors.
+  // The products are summed in double.
+  template<typename StoredType, typename IndexType, typename ValueType>
+  void spmv(const CSRMatrix<StoredType, IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::csrRowsWidened(A, x, y, 0, A.N);
+  }
+
+  template<typename StoredType, typename IndexType, typename ValueType>
+  void spmvParallel(const CSRMatrix<StoredType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.rowPtr, A.N, t, numThreads);
+      spmvkernels::csrRowsWidened(A, x, y, range.first, range.second);
+    });
+  }
+
+  template<typename IndexType, typename ValueType>
+  void spmv(const PatternCSRMatrix<IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::patternRows(A, x, y, 0, A.N);
+  }
+
+  template<typename IndexType, typename ValueType>
+  void spmvParallel(const PatternCSRMatrix<IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.rowPtr, A.N, t, numThreads);
+      spmvkernels::patternRows(A, x, y, range.first, range.second);
+    });
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmv(const CSCMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    for (unsigned int i = 0; i < A.N; i++) {
+      y[i] = 0;
+    }
+    spmvkernels::cscColumns(A, x, y, 0, A.M);
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const CSCMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    spmvkernels::scatterParallel(A.N, y, numThreads, [&](unsigned int t, ValueType *yPart) {
+      std::pair<size_t, size_t> range = balancedRange(A.colPtr, A.M, t, numThreads);
+      spmvkernels::cscColumns(A, x, yPart, range.first, range.second);
+    });
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmv(const COOMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    for (unsigned int i = 0; i < A.N; i++) {
+      y[i] = 0;
+    }
+    spmvkernels::cooElements(A, x, y, 0, A.NZ);
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const COOMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    spmvkernels::scatterParallel(A.N, y, numThreads, [&](unsigned int t, ValueType *yPart) {
+      spmvkernels::cooElements(A, x, yPart, (long)A.NZ * t / numThreads, (long)A.NZ * (t + 1) / numThreads);
+    });
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmv(const SELLMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::sellChunks(A, x, y, 0, A.numChunks);
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const SELLMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.chunkPtr, A.numChunks, t, numThreads);
+      spmvkernels::sellChunks(A, x, y, range.first, range.second);
+    });
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmv(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::bcsrDispatch(A, x, y, 0, A.numBlockRows);
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const BCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.blockRowPtr, A.numBlockRows, t, numThreads);
+      spmvkernels::bcsrDispatch(A, x, y, range.first, range.second);
+    });
+  }
+
+  template<typename ValueType, typename IndexType>
+  void spmv(const DeltaCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y) {
+    spmvkernels::deltaCSRBlocks(A, x, y, 0, A.numBlocks);
+  }
+
+  // The rows are split by element count as for CSR, and the ranges are
+  // rounded to whole blocks.
+  template<typename ValueType, typename IndexType>
+  void spmvParallel(const DeltaCSRMatrix<ValueType, IndexType> &A, const ValueType *x, ValueType *y,
+                    unsigned int numThreads = defaultNumThreads()) {
+    numThreads = std::max(1u, numThreads);
+    runParallel(numThreads, [&](unsigned int t) {
+      std::pair<size_t, size_t> range = balancedRange(A.rowPtr, A.N, t, numThreads);
+      spmvkernels::deltaCSRBlocks(A, x, y, (range.first + A.blockSize - 1) / A.blockSize,
+                                  (range.second + A.blockSize - 1) / A.blockSize);
+    });
+  }
+
+  // y = A * x for a symmetric A, given its lower triangle plus the diagonal
+  // in CSR format (see MMMatrix::toSymmetricCSR). Each stored off-diagonal
+  // element a_ij is used twice, for y_i and for y_j, so the matrix is read
+  // once for both halves, i.e. with about half the memory traffic of an
+  // SpMV over the expanded matrix. For skew-symmetric and Hermitian
+  // matrices, a_ji is the negated or conjugated a_ij.
+  template<typename ValueType, typename IndexType>
+  void spmvSymmetric(const CSRMatrix<ValueType, IndexType> &lower, const ValueType *x, ValueType *y,
+                     Symmetry symmetry = Symmetry::SYMMETRIC) {
+    switch (symmetry) {
+      case Symmetry::SKEW_SYMMETRIC:
+        spmvkernels::spmvHalf(lower, x, y, [](ValueType val) { return -val; });
+        break;
+      case Symmetry::HERMITIAN:
+        spmvkernels::spmvHalf(lower, x, y, [](ValueType val) { return ValueTraits<ValueType>::conj(val); });
+        break;
+      default:
+        spmvkernels::spmvHalf(lower, x, y, [](ValueType val) { return val; });
+        break;
+    }
+  }
+}
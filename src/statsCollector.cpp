@@ -2,60 +2,418 @@
 #include <stdio.h>
 #include "matrix.hpp"
 #include "mmmatrix.hpp"
+#include "reordering.hpp"
+#include "streamstats.hpp"
+#include <algorithm>
+#include <atomic>
+#include <fstream>
+#include <limits>
+#include <mutex>
+#include <set>
+#include <sstream>
 #include <math.h>
+#include <string.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <unistd.h>
 
 using namespace thundercat;
 using namespace std;
 
 bool __DEBUG__ = false;
 
+// Only reordering needs the matrix itself; matrices with more than
+// 2^31 - 1 elements are loaded with long indices, and complex ones with
+// complex values.
+template<typename ValueType, typename IndexType>
+static void printReordered(const string &matrixName, Ordering ordering) {
+  std::unique_ptr<MMMatrix<ValueType, IndexType>> mmMatrix = MMMatrix<ValueType, IndexType>::fromFile(matrixName);
+  std::unique_ptr<MMMatrix<ValueType, IndexType>> reordered = mmMatrix->permuted(mmMatrix->computeOrdering(ordering));
+  std::unique_ptr<CSRMatrix<ValueType, IndexType>> reorderedCSR = reordered->toCSR();
+  printf(" %ld %ld", Reordering::bandwidth(*reorderedCSR), Reordering::profile(*reorderedCSR));
+}
+
+
+// Batch mode: the statistics of many matrices, one record per matrix,
+// appended to a CSV file or to a JSON file with one object per line.
+
+enum class OutputFormat { CSV, JSON };
+
+struct BatchJob {
+  string fileName;
+  size_t footprint;
+};
+
+struct Field {
+  const char *key;
+  string value;
+  bool quoted;
+};
+
+static bool endsWith(const string &str, const string &suffix) {
+  return str.size() >= suffix.size() && str.compare(str.size() - suffix.size(), suffix.size(), suffix) == 0;
+}
+
+static bool isDirectory(const string &path) {
+  struct stat info;
+  return stat(path.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+// Adds the .mtx files under directory, recursively.
+static void findMatrices(const string &directory, vector<string> &fileNames) {
+  DIR *dir = opendir(directory.c_str());
+  if (dir == NULL) {
+    cerr << "Problem opening directory " << directory << ".\n";
+    exit(1);
+  }
+  while (struct dirent *entry = readdir(dir)) {
+    string name(entry->d_name);
+    if (name == "." || name == "..")
+      continue;
+    string path = directory + "/" + name;
+    if (isDirectory(path)) {
+      findMatrices(path, fileNames);
+    } else if (endsWith(name, ".mtx")) {
+      fileNames.push_back(path);
+    }
+  }
+  closedir(dir);
+}
+
+// One file name per line; empty lines are skipped.
+static vector<string> readList(const string &listName) {
+  std::ifstream list(listName);
+  if (!list) {
+    cerr << "Problem opening file " << listName << ".\n";
+    exit(1);
+  }
+  vector<string> fileNames;
+  string line;
+  while (std::getline(list, line)) {
+    if (!line.empty()) {
+      fileNames.push_back(line);
+    }
+  }
+  return fileNames;
+}
+
+static const char *symmetryName(Symmetry symmetry) {
+  switch (symmetry) {
+    case Symmetry::SYMMETRIC: return "symmetric";
+    case Symmetry::SKEW_SYMMETRIC: return "skew-symmetric";
+    case Symmetry::HERMITIAN: return "hermitian";
+    default: return "general";
+  }
+}
+
+static string quote(const string &str, OutputFormat format) {
+  string quoted = "\"";
+  for (char c : str) {
+    if (format == OutputFormat::CSV) {
+      quoted += c == '"' ? "\"\"" : string(1, c);
+    } else if (c == '"' || c == '\\') {
+      quoted += '\\';
+      quoted += c;
+    } else if ((unsigned char)c < 0x20) {
+      char escaped[8];
+      snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+      quoted += escaped;
+    } else {
+      quoted += c;
+    }
+  }
+  return quoted + "\"";
+}
+
+// Reads the quoted string at the start of str, as written by quote.
+static string unquote(const string &str, OutputFormat format) {
+  string unquoted;
+  for (size_t i = 1; i < str.size(); i++) {
+    char c = str[i];
+    if (c == '"') {
+      if (format == OutputFormat::CSV && i + 1 < str.size() && str[i + 1] == '"') {
+        unquoted += '"';
+        i++;
+        continue;
+      }
+      break;
+    }
+    if (format == OutputFormat::JSON && c == '\\' && i + 1 < str.size()) {
+      c = str[++i];
+      if (c == 'u' && i + 4 < str.size()) {
+        c = (char)strtol(str.substr(i + 1, 4).c_str(), NULL, 16);
+        i += 4;
+      }
+    }
+    unquoted += c;
+  }
+  return unquoted;
+}
+
+static string number(long value) {
+  return std::to_string(value);
+}
+
+// Statistics of matrices without rows, or with equal rows, can be NaN.
+static string number(double value, OutputFormat format) {
+  if (!std::isfinite(value)) {
+    return format == OutputFormat::JSON ? "null" : "nan";
+  }
+  char text[32];
+  snprintf(text, sizeof(text), "%.6g", value);
+  return text;
+}
+
+static vector<Field> fields(const string &fileName, const MatrixStats &stats, OutputFormat format) {
+  return {
+    {"matrix", fileName, true},
+    {"N", number(stats.N), false},
+    {"M", number(stats.M), false},
+    {"NZ", number(stats.NZ), false},
+    {"symmetry", symmetryName(stats.symmetry), true},
+    {"meanRowLength", number(stats.meanRowLength, format), false},
+    {"maxRowLength", number(stats.maxRowLength), false},
+    {"rowStdDev", number(stats.rowStdDev, format), false},
+    {"rowVariation", number(stats.rowVariation, format), false},
+    {"rowSkewness", number(stats.rowSkewness, format), false},
+    {"disparity", number(stats.disparity, format), false},
+    {"bandwidth", number(stats.bandwidth), false},
+    {"profile", number(stats.profile), false},
+    {"emptyRows", number(stats.emptyRows), false},
+    {"emptyCols", number(stats.emptyCols), false},
+    {"maxColLength", number(stats.maxColLength), false},
+    {"colStdDev", number(stats.colStdDev, format), false},
+    {"diagonalDominance", number(stats.diagonalDominance, format), false}
+  };
+}
+
+// CSV records end with an error column, empty unless the matrix could
+// not be read; JSON records then have only the matrix and the error.
+static string csvHeader() {
+  string header;
+  for (auto &field : fields("", MatrixStats(), OutputFormat::CSV)) {
+    header += field.key;
+    header += ",";
+  }
+  return header + "error\n";
+}
+
+static string errorRecord(const string &fileName, string error, OutputFormat format) {
+  if (!error.empty() && error.back() == '\n') {
+    error.pop_back();
+  }
+  if (format == OutputFormat::JSON) {
+    return "{\"matrix\": " + quote(fileName, format) + ", \"error\": " + quote(error, format) + "}\n";
+  }
+  return quote(fileName, format) + string(fields("", MatrixStats(), format).size(), ',') +
+    quote(error, format) + "\n";
+}
+
+static string record(const string &fileName, const MatrixStats &stats, OutputFormat format) {
+  std::ostringstream line;
+  bool first = true;
+  line << (format == OutputFormat::JSON ? "{" : "");
+  for (auto &field : fields(fileName, stats, format)) {
+    string value = field.quoted ? quote(field.value, format) : field.value;
+    if (format == OutputFormat::JSON) {
+      line << (first ? "" : ", ") << "\"" << field.key << "\": " << value;
+    } else {
+      line << (first ? "" : ",") << value;
+    }
+    first = false;
+  }
+  line << (format == OutputFormat::JSON ? "}\n" : ",\n");
+  return line.str();
+}
+
+// Returns the matrices recorded by a previous run into outputName, after
+// cutting off a last line left incomplete by an interrupted run.
+static std::set<string> readRecorded(const string &outputName, OutputFormat format) {
+  std::set<string> recorded;
+  std::ifstream output(outputName, std::ios::binary);
+  if (!output) {
+    return recorded;
+  }
+  std::stringstream contents;
+  contents << output.rdbuf();
+  output.close();
+  string text = contents.str();
+  size_t end = text.rfind('\n') == string::npos ? 0 : text.rfind('\n') + 1;
+  if (end < text.size() && truncate(outputName.c_str(), end) != 0) {
+    cerr << "Problem truncating file " << outputName << ".\n";
+    exit(1);
+  }
+  std::istringstream lines(text.substr(0, end));
+  string line;
+  const string jsonPrefix = "{\"matrix\": ";
+  while (std::getline(lines, line)) {
+    if (format == OutputFormat::CSV && line.compare(0, 1, "\"") == 0) {
+      recorded.insert(unquote(line, format));
+    } else if (format == OutputFormat::JSON && line.compare(0, jsonPrefix.size(), jsonPrefix) == 0) {
+      recorded.insert(unquote(line.substr(jsonPrefix.size()), format));
+    }
+  }
+  return recorded;
+}
+
+// Matrices whose footprint exceeds memoryBudget / numWorkers are run one
+// at a time, with all threads; the rest are run numWorkers at a time,
+// with one thread each, largest first. Results are appended as they
+// come, and matrices already in the output are skipped. A file that
+// cannot be read gets an error record, and the batch goes on.
+static void runBatch(const string &input, const string &outputName, size_t memoryBudget) {
+  OutputFormat format = endsWith(outputName, ".json") || endsWith(outputName, ".jsonl") ?
+    OutputFormat::JSON : OutputFormat::CSV;
+  vector<string> fileNames;
+  if (isDirectory(input)) {
+    findMatrices(input, fileNames);
+  } else {
+    fileNames = readList(input);
+  }
+  std::sort(fileNames.begin(), fileNames.end());
+  fileNames.erase(std::unique(fileNames.begin(), fileNames.end()), fileNames.end());
+  std::set<string> recorded = readRecorded(outputName, format);
+
+  FILE *output = fopen(outputName.c_str(), "a");
+  if (output == NULL) {
+    cerr << "Problem opening file " << outputName << ".\n";
+    exit(1);
+  }
+  if (format == OutputFormat::CSV && ftell(output) == 0) {
+    fputs(csvHeader().c_str(), output);
+  }
+  std::mutex outputMutex;
+  std::atomic<size_t> numErrors(0);
+  auto write = [&](const string &line) {
+    std::lock_guard<std::mutex> lock(outputMutex);
+    fputs(line.c_str(), output);
+    fflush(output);
+  };
+  auto writeError = [&](const string &fileName, const string &error) {
+    numErrors++;
+    write(errorRecord(fileName, error, format));
+  };
+
+  vector<BatchJob> jobs;
+  size_t numSkipped = 0;
+  for (auto &fileName : fileNames) {
+    if (recorded.count(fileName) != 0) {
+      numSkipped++;
+    } else {
+      string error;
+      auto reader = MMReader::tryOpen(fileName, true, error);
+      if (reader) {
+        jobs.push_back({fileName, StreamStats::footprint(*reader)});
+      } else {
+        writeError(fileName, error);
+      }
+    }
+  }
+  std::stable_sort(jobs.begin(), jobs.end(), [](const BatchJob &a, const BatchJob &b) {
+    return a.footprint > b.footprint;
+  });
+
+  auto process = [&](const BatchJob &job, unsigned int numThreads) {
+    string error;
+    auto reader = MMReader::tryOpen(job.fileName, true, error);
+    std::unique_ptr<MatrixStats> stats;
+    if (reader) {
+      stats = StreamStats::tryCollect(*reader, error, numThreads);
+    }
+    if (stats) {
+      write(record(job.fileName, *stats, format));
+    } else {
+      writeError(job.fileName, error);
+    }
+  };
+
+  const unsigned int numWorkers = defaultNumThreads();
+  size_t next = 0;
+  while (next < jobs.size() && jobs[next].footprint > memoryBudget / numWorkers) {
+    process(jobs[next++], numWorkers);
+  }
+  std::atomic<size_t> nextJob(next);
+  runParallel(std::min((size_t)numWorkers, jobs.size() - next), [&](unsigned int) {
+    for (size_t job = nextJob++; job < jobs.size(); job = nextJob++) {
+      process(jobs[job], 1);
+    }
+  });
+  fclose(output);
+  cerr << "Recorded " << fileNames.size() - numSkipped << " matrices, " << numErrors << " with errors; "
+       << numSkipped << " were already in " << outputName << ".\n";
+}
+
+
 int main(int argc, const char *argv[]) {
-  // Usage: ./test <matrixFilePath>
+  // Usage: ./test <matrixFilePath> [rcm|degree|bisection]
+  //        ./test --batch <directory|listFile> <output.csv|output.json> [memoryBudgetMB]
+  if (argc > 1 && strcmp(argv[1], "--batch") == 0) {
+    if (argc < 4) {
+      cerr << "You must give me a directory or a list of .mtx files, and an output file.\n";
+      exit(1);
+    }
+    // By default, half of the physical memory.
+    size_t memoryBudget = (size_t)sysconf(_SC_PHYS_PAGES) * sysconf(_SC_PAGESIZE) / 2;
+    if (argc > 4) {
+      memoryBudget = (size_t)atol(argv[4]) << 20;
+    }
+    runBatch(argv[2], argv[3], memoryBudget);
+    return 0;
+  }
   if (argc < 2) {
     cerr << "You must give me a .mtx filename.\n";
     exit(1);
   }
   string matrixName(argv[1]);
-  std::unique_ptr<MMMatrix<double>> mmMatrix = MMMatrix<double>::fromFile(matrixName);
-  std::unique_ptr<CSRMatrix<double>> csrMatrix = mmMatrix->toCSR();
-
-  // General info
-  int N = csrMatrix->N;
-  int M = csrMatrix->M;
-  int NZ = csrMatrix->NZ;
-  double meanRowLength = NZ / (double)N;
-  bool symmetric = mmMatrix->isSymmetric();
-  printf("%d %d %d %s %.5f ", N, M, NZ, symmetric ? "sym" : "unsym", meanRowLength);
-
-  // Row length info
-  int maxRowLength = 0;
-  double disparity = 0;
-  double sum = 0;
-  double skewness = 0;
-  for (int i = 0; i < N; i++) {
-    int length = csrMatrix->rowPtr[i+1] - csrMatrix->rowPtr[i];
-    if (length > maxRowLength) {
-      maxRowLength = length;
-    }
-    double diff = length - meanRowLength;
-    sum += diff * diff;
-    skewness += (diff * diff * diff);
-    double sumDistances = 0;
-    if (length != 0){
-      for (int j = csrMatrix->rowPtr[i]; j < csrMatrix->rowPtr[i+1] - 1; j++) {
-        sumDistances += csrMatrix->colIndices[j+1] - csrMatrix->colIndices[j];
-      }
-      disparity += sumDistances / length;
+  bool reorder = argc > 2;
+  Ordering ordering = Ordering::RCM;
+  if (reorder) {
+    if (strcmp(argv[2], "degree") == 0) {
+      ordering = Ordering::DEGREE;
+    } else if (strcmp(argv[2], "bisection") == 0) {
+      ordering = Ordering::BISECTION;
+    } else if (strcmp(argv[2], "rcm") != 0) {
+      cerr << "Unknown ordering " << argv[2] << "; use rcm, degree or bisection.\n";
+      exit(1);
     }
   }
-  double variance = sum / N;
-  double stdDev = sqrt(variance);
-  disparity = disparity / N;
-  double variation = stdDev / meanRowLength;
-  skewness = (skewness / N) / pow(stdDev, 3.0);
-  printf("%d %.5f %.5f %.5f %.5f", maxRowLength, stdDev, variation, skewness, disparity);
 
+  auto reader = MMReader::open(matrixName, true);
+  MatrixStats stats = StreamStats::collect(*reader);
+
+  // General info and row length info
+  printf("%d %d %ld %s %.5f ", (int)stats.N, (int)stats.M, stats.NZ,
+         stats.symmetry == Symmetry::SYMMETRIC ? "sym" : "unsym", stats.meanRowLength);
+  printf("%ld %.5f %.5f %.5f %.5f", stats.maxRowLength, stats.rowStdDev, stats.rowVariation,
+         stats.rowSkewness, stats.disparity);
+
+  // Bandwidth and profile
+  printf(" %ld %ld", stats.bandwidth, stats.profile);
+
+  // Column and diagonal info
+  printf(" %ld %ld %ld %.5f %.5f", stats.emptyRows, stats.emptyCols, stats.maxColLength,
+         stats.colStdDev, stats.diagonalDominance);
+
+  // With an ordering, bandwidth and profile after reordering, last so
+  // that the other fields keep their positions
+  if (reorder) {
+    // The expanded size of a symmetric matrix is at most twice the entries.
+    long maxElements = stats.symmetry == Symmetry::GENERAL ? reader->NZ : 2 * reader->NZ;
+    const bool longIndices = maxElements > std::numeric_limits<int>::max();
+    const bool complexValues = reader->isComplex();
+    reader.reset();
+    if (complexValues) {
+      if (longIndices) {
+        printReordered<std::complex<double>, long>(matrixName, ordering);
+      } else {
+        printReordered<std::complex<double>, int>(matrixName, ordering);
+      }
+    } else if (longIndices) {
+      printReordered<double, long>(matrixName, ordering);
+    } else {
+      printReordered<double, int>(matrixName, ordering);
+    }
+  }
   printf("\n");
   return 0;
 }
-
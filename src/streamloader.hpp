@@ -0,0 +1,182 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "mmreader.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <atomic>
+#include <limits>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  // Builds CSR/CSC matrices straight from a Matrix Market file, without
+  // going through MMMatrix. The file is scanned twice: the first pass
+  // counts the entries of each row (column), whose prefix sums give the
+  // row (column) pointers; the second pass scatters the entries into
+  // place. Finally, each row (column) is sorted by its column (row)
+  // indices. This takes O(NZ) time for bounded row lengths, and the peak
+  // memory is the final matrix plus O(N + M).
+  //
+  // Symmetric, skew-symmetric and Hermitian matrices are expanded
+  // as in MMMatrix::fromFile.
+  // Duplicate entries are kept; when more than one thread is used,
+  // their relative order within a row (column) is unspecified. The load
+  // exits if the matrix does not fit IndexType (see MMMatrix).
+  template<typename ValueType, typename IndexType = int>
+  class StreamLoader {
+  public:
+    static std::unique_ptr<CSRMatrix<ValueType, IndexType>> loadCSR(std::string fileName,
+                                                                    unsigned int numThreads = defaultNumThreads()) {
+      auto reader = MMReader::open(fileName, ValueTraits<ValueType>::isComplex);
+      IndexType *rowPtr;
+      IndexType *cols;
+      ValueType *vals;
+      long sz = load(*reader, true, numThreads, rowPtr, cols, vals);
+      return std::make_unique<CSRMatrix<ValueType, IndexType>>(rowPtr, cols, vals, reader->N, reader->M, sz);
+    }
+
+    static std::unique_ptr<CSCMatrix<ValueType, IndexType>> loadCSC(std::string fileName,
+                                                                    unsigned int numThreads = defaultNumThreads()) {
+      auto reader = MMReader::open(fileName, ValueTraits<ValueType>::isComplex);
+      IndexType *colPtr;
+      IndexType *rows;
+      ValueType *vals;
+      long sz = load(*reader, false, numThreads, colPtr, rows, vals);
+      return std::make_unique<CSCMatrix<ValueType, IndexType>>(rows, colPtr, vals, reader->N, reader->M, sz);
+    }
+
+  private:
+    // Rows (columns) up to this length are sorted in place.
+    static const int insertionSortLimit = 32;
+
+    // Fills in the pointer, minor index and value arrays of a CSR matrix
+    // if byRow, of a CSC matrix otherwise. Returns the number of elements.
+    static long load(const MMReader &reader, bool byRow, unsigned int numThreads,
+                     IndexType *&ptr, IndexType *&indices, ValueType *&vals) {
+      const Symmetry symmetry = reader.getSymmetry();
+      const bool symmetric = symmetry != Symmetry::GENERAL;
+      const long numMajor = byRow ? reader.N : reader.M;
+      const long numMinor = byRow ? reader.M : reader.N;
+      checkIndexRange(std::max(numMajor, numMinor));
+      std::vector<const char*> bounds = reader.split(numThreads);
+      const unsigned int numChunks = bounds.size() - 1;
+
+      // Pass 1: count the elements of each row (column).
+      std::unique_ptr<std::atomic<IndexType>[]> counts(new std::atomic<IndexType>[numMajor]());
+      std::atomic<long> numEntries(0);
+      std::atomic<bool> outOfBounds(false);
+      runParallel(numChunks, [&](unsigned int chunk) {
+        numEntries += reader.scanIndices(bounds[chunk], bounds[chunk + 1], [&](long row, long col) {
+          long major = byRow ? row : col;
+          long minor = byRow ? col : row;
+          if (major < 0 || major >= numMajor || minor < 0 || minor >= numMinor ||
+              (symmetric && (minor >= numMajor || major >= numMinor))) {
+            outOfBounds = true;
+            return;
+          }
+          counts[major].fetch_add(1, std::memory_order_relaxed);
+          if (symmetric && row != col) {
+            counts[minor].fetch_add(1, std::memory_order_relaxed);
+          }
+        });
+      });
+      if (outOfBounds) {
+        std::cerr << "Entry index out of bounds.\n";
+        exit(1);
+      }
+      if (numEntries != reader.NZ) {
+        std::cerr << "Expected " << reader.NZ << " entries, found " << numEntries << ".\n";
+        exit(1);
+      }
+
+      // The total may not fit IndexType even if each count does.
+      long sz = 0;
+      for (long i = 0; i < numMajor; i++) {
+        sz += counts[i].load(std::memory_order_relaxed);
+      }
+      checkIndexRange(sz);
+      ptr = new IndexType[numMajor + 1];
+      ptr[0] = 0;
+      for (long i = 0; i < numMajor; i++) {
+        ptr[i + 1] = ptr[i] + counts[i].load(std::memory_order_relaxed);
+      }
+
+      // Pass 2: scatter. The counts are reused as insertion cursors.
+      for (long i = 0; i < numMajor; i++) {
+        counts[i].store(ptr[i], std::memory_order_relaxed);
+      }
+      indices = new IndexType[sz];
+      vals = new ValueType[sz];
+      runParallel(numChunks, [&](unsigned int chunk) {
+        reader.scanComplex(bounds[chunk], bounds[chunk + 1],
+                           [&](long row, long col, double real, double imag) {
+          IndexType major = byRow ? row : col;
+          IndexType minor = byRow ? col : row;
+          ValueType val = ValueTraits<ValueType>::make(real, imag);
+          IndexType pos = counts[major].fetch_add(1, std::memory_order_relaxed);
+          indices[pos] = minor;
+          vals[pos] = val;
+          if (symmetric && row != col) {
+            pos = counts[minor].fetch_add(1, std::memory_order_relaxed);
+            indices[pos] = major;
+            vals[pos] = mirrorValue(symmetry, val);
+          }
+        });
+      });
+      counts.reset();
+
+      // Sort each row (column); ranges of rows are balanced by element count.
+      const unsigned int numSortThreads = std::max(1u, std::min(numThreads, (unsigned int)numMajor));
+      runParallel(numSortThreads, [&](unsigned int t) {
+        std::pair<size_t, size_t> range = balancedRange(ptr, numMajor, t, numSortThreads);
+        for (size_t i = range.first; i < range.second; i++) {
+          sortSegment(indices + ptr[i], vals + ptr[i], ptr[i + 1] - ptr[i]);
+        }
+      });
+      return sz;
+    }
+
+    static void checkIndexRange(long n) {
+      if (n > (long)std::numeric_limits<IndexType>::max()) {
+        std::cerr << "The matrix is too large for " << sizeof(IndexType) * 8
+                  << "-bit indices; use a 64-bit IndexType.\n";
+        exit(1);
+      }
+    }
+
+    // Stable sort of a row (column) by minor index.
+    static void sortSegment(IndexType *indices, ValueType *vals, IndexType length) {
+      if (length <= insertionSortLimit) {
+        for (IndexType i = 1; i < length; i++) {
+          IndexType index = indices[i];
+          ValueType val = vals[i];
+          IndexType j = i - 1;
+          while (j >= 0 && indices[j] > index) {
+            indices[j + 1] = indices[j];
+            vals[j + 1] = vals[j];
+            j--;
+          }
+          indices[j + 1] = index;
+          vals[j + 1] = val;
+        }
+        return;
+      }
+
+      std::vector< std::pair<IndexType, ValueType> > segment(length);
+      for (IndexType i = 0; i < length; i++) {
+        segment[i] = std::make_pair(indices[i], vals[i]);
+      }
+      std::stable_sort(segment.begin(), segment.end(),
+                       [](const std::pair<IndexType, ValueType> &a, const std::pair<IndexType, ValueType> &b) {
+        return a.first < b.first;
+      });
+      for (IndexType i = 0; i < length; i++) {
+        indices[i] = segment[i].first;
+        vals[i] = segment[i].second;
+      }
+    }
+  };
+}
@@ -0,0 +1,243 @@
+#include "streamstats.hpp"
+#include <math.h>
+#include <stdlib.h>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <limits>
+#include <memory>
+#include <vector>
+
+using namespace thundercat;
+
+// The updates are read-modify-writes only when chunks are scanned
+// concurrently; a single chunk is scanned with plain loads and stores.
+template<bool Concurrent>
+static void addTo(std::atomic<long> &target, long value) {
+  if (Concurrent) {
+    target.fetch_add(value, std::memory_order_relaxed);
+  } else {
+    target.store(target.load(std::memory_order_relaxed) + value, std::memory_order_relaxed);
+  }
+}
+
+template<bool Concurrent>
+static void addTo(std::atomic<double> &target, double value) {
+  double current = target.load(std::memory_order_relaxed);
+  if (Concurrent) {
+    while (!target.compare_exchange_weak(current, current + value, std::memory_order_relaxed)) { }
+  } else {
+    target.store(current + value, std::memory_order_relaxed);
+  }
+}
+
+template<bool Concurrent>
+static void lowerTo(std::atomic<long> &target, long value) {
+  long current = target.load(std::memory_order_relaxed);
+  if (Concurrent) {
+    while (value < current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+  } else if (value < current) {
+    target.store(value, std::memory_order_relaxed);
+  }
+}
+
+template<bool Concurrent>
+static void raiseTo(std::atomic<long> &target, long value) {
+  long current = target.load(std::memory_order_relaxed);
+  if (Concurrent) {
+    while (value > current && !target.compare_exchange_weak(current, value, std::memory_order_relaxed)) { }
+  } else if (value > current) {
+    target.store(value, std::memory_order_relaxed);
+  }
+}
+
+// The counters of a row are kept together in 32 bytes, as the entries of
+// a row are scattered in the file and each costs a cache miss otherwise.
+// The diagonal, which has few entries, is kept apart.
+struct RowCounters {
+  std::atomic<long> length;
+  std::atomic<long> first;
+  std::atomic<long> last;
+  std::atomic<double> offDiagonal;
+};
+
+struct DiagonalSum {
+  std::atomic<double> real;
+  std::atomic<double> imag;
+};
+
+// Returns an error message, or an empty string.
+template<bool Concurrent>
+static std::string scanChunks(const MMReader &reader, const std::vector<const char*> &bounds,
+                       RowCounters *rows, DiagonalSum *diagonals, std::atomic<long> *colLengths) {
+  const long N = reader.N;
+  const long M = reader.M;
+  const bool expand = reader.getSymmetry() != Symmetry::GENERAL;
+  auto addElement = [&](long row, long col, double real, double imag) {
+    RowCounters &counters = rows[row];
+    addTo<Concurrent>(counters.length, 1);
+    lowerTo<Concurrent>(counters.first, col);
+    raiseTo<Concurrent>(counters.last, col);
+    if (row == col) {
+      addTo<Concurrent>(diagonals[row].real, real);
+      addTo<Concurrent>(diagonals[row].imag, imag);
+    } else {
+      addTo<Concurrent>(counters.offDiagonal, imag == 0.0 ? fabs(real) : hypot(real, imag));
+    }
+    addTo<Concurrent>(colLengths[col], 1);
+  };
+
+  // Entries are parsed into a small batch before the counters are
+  // updated, and the counters of the batch are prefetched, so that the
+  // cache misses of scattered rows overlap rather than stall the parser.
+  const int batchSize = 256;
+  std::atomic<long> numEntries(0);
+  std::atomic<bool> outOfBounds(false);
+  std::atomic<bool> malformed(false);
+  runParallel(bounds.size() - 1, [&](unsigned int chunk) {
+    long batchRows[batchSize];
+    long batchCols[batchSize];
+    double batchReals[batchSize];
+    double batchImags[batchSize];
+    int batchLength = 0;
+    auto flush = [&]() {
+      for (int k = 0; k < batchLength; k++) {
+        __builtin_prefetch(&rows[batchRows[k]], 1);
+        __builtin_prefetch(&colLengths[batchCols[k]], 1);
+      }
+      for (int k = 0; k < batchLength; k++) {
+        addElement(batchRows[k], batchCols[k], batchReals[k], batchImags[k]);
+      }
+      batchLength = 0;
+    };
+    auto push = [&](long row, long col, double real, double imag) {
+      batchRows[batchLength] = row;
+      batchCols[batchLength] = col;
+      batchReals[batchLength] = real;
+      batchImags[batchLength] = imag;
+      if (++batchLength == batchSize) {
+        flush();
+      }
+    };
+    numEntries += reader.scanComplex(bounds[chunk], bounds[chunk + 1],
+                                     [&](long row, long col, double real, double imag) {
+      if (row < 0 || row >= N || col < 0 || col >= M || (expand && (col >= N || row >= M))) {
+        outOfBounds = true;
+        return;
+      }
+      push(row, col, real, imag);
+      if (expand && row != col) {
+        // Negating or conjugating the value does not change |a_ij|.
+        push(col, row, real, imag);
+      }
+    }, &malformed);
+    flush();
+  });
+  if (malformed) {
+    return "Malformed entry in the coordinate section.\n";
+  }
+  if (outOfBounds) {
+    return "Entry index out of bounds.\n";
+  }
+  if (numEntries != reader.NZ) {
+    return "Expected " + std::to_string(reader.NZ) + " entries, found " + std::to_string(numEntries) + ".\n";
+  }
+  return "";
+}
+
+MatrixStats StreamStats::collect(const std::string &fileName, unsigned int numThreads) {
+  auto reader = MMReader::open(fileName, true);
+  return collect(*reader, numThreads);
+}
+
+size_t StreamStats::footprint(const MMReader &reader) {
+  return reader.N * (sizeof(RowCounters) + sizeof(DiagonalSum)) + reader.M * sizeof(std::atomic<long>) +
+    (reader.bodyEnd() - reader.bodyBegin());
+}
+
+MatrixStats StreamStats::collect(const MMReader &reader, unsigned int numThreads) {
+  std::string error;
+  auto stats = tryCollect(reader, error, numThreads);
+  if (!stats) {
+    std::cerr << error;
+    exit(1);
+  }
+  return *stats;
+}
+
+std::unique_ptr<MatrixStats> StreamStats::tryCollect(const MMReader &reader, std::string &error,
+                                                     unsigned int numThreads) {
+  const long N = reader.N;
+  const long M = reader.M;
+  std::unique_ptr<RowCounters[]> rows(new RowCounters[N]);
+  std::unique_ptr<DiagonalSum[]> diagonals(new DiagonalSum[N]);
+  std::unique_ptr<std::atomic<long>[]> colLengths(new std::atomic<long>[M]());
+  for (long i = 0; i < N; i++) {
+    rows[i].length.store(0, std::memory_order_relaxed);
+    rows[i].first.store(std::numeric_limits<long>::max(), std::memory_order_relaxed);
+    rows[i].last.store(-1, std::memory_order_relaxed);
+    rows[i].offDiagonal.store(0.0, std::memory_order_relaxed);
+    diagonals[i].real.store(0.0, std::memory_order_relaxed);
+    diagonals[i].imag.store(0.0, std::memory_order_relaxed);
+  }
+  std::vector<const char*> bounds = reader.split(numThreads);
+  if (bounds.size() > 2) {
+    error = scanChunks<true>(reader, bounds, rows.get(), diagonals.get(), colLengths.get());
+  } else {
+    error = scanChunks<false>(reader, bounds, rows.get(), diagonals.get(), colLengths.get());
+  }
+  if (!error.empty()) {
+    return nullptr;
+  }
+
+  // Summarize in row order, which keeps the sums as the CSR-based
+  // collector computed them.
+  std::unique_ptr<MatrixStats> result(new MatrixStats());
+  MatrixStats &stats = *result;
+  stats.N = N;
+  stats.M = M;
+  stats.symmetry = reader.getSymmetry();
+  for (long i = 0; i < N; i++) {
+    stats.NZ += rows[i].length;
+  }
+  stats.meanRowLength = stats.NZ / (double)N;
+  double sum = 0;
+  double skewness = 0;
+  long numDominant = 0;
+  for (long i = 0; i < N; i++) {
+    const long length = rows[i].length;
+    stats.maxRowLength = std::max(stats.maxRowLength, length);
+    double diff = length - stats.meanRowLength;
+    sum += diff * diff;
+    skewness += diff * diff * diff;
+    if (length == 0) {
+      stats.emptyRows++;
+      continue;
+    }
+    const long first = rows[i].first;
+    const long last = rows[i].last;
+    stats.disparity += (double)(last - first) / length;
+    stats.bandwidth = std::max(stats.bandwidth, std::max(labs(i - first), labs(last - i)));
+    stats.profile += i - std::min(i, first);
+    if (hypot(diagonals[i].real.load(), diagonals[i].imag.load()) >= rows[i].offDiagonal.load()) {
+      numDominant++;
+    }
+  }
+  stats.rowStdDev = sqrt(sum / N);
+  stats.disparity /= N;
+  stats.rowVariation = stats.rowStdDev / stats.meanRowLength;
+  stats.rowSkewness = (skewness / N) / pow(stats.rowStdDev, 3.0);
+  stats.diagonalDominance = numDominant / (double)N;
+
+  const double meanColLength = stats.NZ / (double)M;
+  double colSum = 0;
+  for (long j = 0; j < M; j++) {
+    const long length = colLengths[j];
+    stats.maxColLength = std::max(stats.maxColLength, length);
+    stats.emptyCols += length == 0;
+    double diff = length - meanColLength;
+    colSum += diff * diff;
+  }
+  stats.colStdDev = sqrt(colSum / M);
+  return result;
+}
@@ -0,0 +1,60 @@
+#pragma once
+
+#include "mmreader.hpp"
+#include "parallel.hpp"
+#include <memory>
+#include <string>
+
+namespace thundercat {
+  // Structural statistics of a matrix, as printed by collectMatrixStats.
+  // Symmetric, skew-symmetric and Hermitian matrices are counted as
+  // expanded, and duplicate entries as separate elements.
+  struct MatrixStats {
+    long N;
+    long M;
+    long NZ;
+    Symmetry symmetry;
+    double meanRowLength;
+    long maxRowLength;
+    double rowStdDev;
+    double rowVariation; // rowStdDev / meanRowLength
+    double rowSkewness;
+    // The mean over the rows of the average distance between the sorted
+    // columns of the row, i.e. (last column - first column) / length.
+    double disparity;
+    long bandwidth; // as Reordering::bandwidth
+    long profile; // as Reordering::profile
+    long emptyRows;
+    long emptyCols;
+    long maxColLength;
+    double colStdDev;
+    // The fraction of rows that are not empty and have |a_ii| >= the sum
+    // of |a_ij| over j != i, with complex values by magnitude; duplicate
+    // elements are summed first on the diagonal only.
+    double diagonalDominance;
+  };
+
+  // Computes MatrixStats while scanning a Matrix Market file, in
+  // parallel, without building the matrix: the threads parse chunks of
+  // the file and update per-row and per-column counters atomically, so
+  // the memory taken is O(N + M) besides the mapped file. The row
+  // statistics need only the length and the first and last column of
+  // each row, hence the rows need not be sorted. Complex-valued files
+  // are accepted.
+  class StreamStats {
+  public:
+    static MatrixStats collect(const std::string &fileName, unsigned int numThreads = defaultNumThreads());
+
+    // The reader must allow complex values if the file has them.
+    static MatrixStats collect(const MMReader &reader, unsigned int numThreads = defaultNumThreads());
+
+    // Like collect, but returns null and sets error instead of exiting on
+    // a malformed file.
+    static std::unique_ptr<MatrixStats> tryCollect(const MMReader &reader, std::string &error,
+                                                   unsigned int numThreads = defaultNumThreads());
+
+    // An upper bound of the bytes collect takes for the file of reader,
+    // counting the whole file as resident.
+    static size_t footprint(const MMReader &reader);
+  };
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  // Converts between CSR and CSC directly, in O(NZ + numThreads * (N + M))
+  // time, instead of sorting the elements again as MMMatrix::toCSC does.
+  // The rows (columns) are split among the threads by element count;
+  // each thread counts the columns (rows) of its range, the counts are
+  // turned into per-thread insertion offsets, and each thread scatters
+  // its range in order. Hence, if the input has sorted indices within
+  // each row (column), so does the output.
+  //
+  // The counts take numThreads * (M + 1) indices, so fewer threads are used
+  // when there are fewer elements than that.
+  class Transpose {
+  public:
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<CSCMatrix<ValueType, IndexType>> toCSC(const CSRMatrix<ValueType, IndexType> &csr,
+                                                                  unsigned int numThreads = defaultNumThreads()) {
+      IndexType *colPtr = new IndexType[csr.M + 1];
+      IndexType *rows = new IndexType[csr.NZ];
+      ValueType *vals = new ValueType[csr.NZ];
+      transpose(csr.rowPtr, csr.colIndices, csr.values, csr.N, csr.M, numThreads, colPtr, rows, vals);
+      return std::make_unique<CSCMatrix<ValueType, IndexType>>(rows, colPtr, vals, csr.N, csr.M, csr.NZ);
+    }
+
+    template<typename ValueType, typename IndexType>
+    static std::unique_ptr<CSRMatrix<ValueType, IndexType>> toCSR(const CSCMatrix<ValueType, IndexType> &csc,
+                                                                  unsigned int numThreads = defaultNumThreads()) {
+      IndexType *rowPtr = new IndexType[csc.N + 1];
+      IndexType *cols = new IndexType[csc.NZ];
+      ValueType *vals = new ValueType[csc.NZ];
+      transpose(csc.colPtr, csc.rowIndices, csc.values, csc.M, csc.N, numThreads, rowPtr, cols, vals);
+      return std::make_unique<CSRMatrix<ValueType, IndexType>>(rowPtr, cols, vals, csc.N, csc.M, csc.NZ);
+    }
+
+  private:
+    // Transposes the numMajor x numMinor compressed matrix (ptr, indices,
+    // vals) into (outPtr, outIndices, outVals).
+    template<typename ValueType, typename IndexType>
+    static void transpose(const IndexType *ptr, const IndexType *indices, const ValueType *vals,
+                          size_t numMajor, size_t numMinor, unsigned int numThreads,
+                          IndexType *outPtr, IndexType *outIndices, ValueType *outVals) {
+      const long sz = ptr[numMajor];
+      numThreads = std::max(1L, std::min((long)numThreads, sz / (long)(numMinor + 1)));
+      std::vector< std::vector<IndexType> > counts(numThreads);
+
+      // Count the minor indices of each thread's range.
+      runParallel(numThreads, [&](unsigned int t) {
+        std::vector<IndexType> &threadCounts = counts[t];
+        threadCounts.assign(numMinor, 0);
+        std::pair<size_t, size_t> range = balancedRange(ptr, numMajor, t, numThreads);
+        for (IndexType k = ptr[range.first]; k < ptr[range.second]; k++) {
+          threadCounts[indices[k]]++;
+        }
+      });
+
+      // Per minor index, turn the counts into offsets of the threads
+      // relative to the start of its output range, and get the total.
+      std::vector<IndexType> totals(numMinor);
+      runParallel(numThreads, [&](unsigned int t) {
+        const size_t begin = numMinor * t / numThreads;
+        const size_t end = numMinor * (t + 1) / numThreads;
+        for (size_t j = begin; j < end; j++) {
+          IndexType offset = 0;
+          for (unsigned int p = 0; p < numThreads; p++) {
+            IndexType count = counts[p][j];
+            counts[p][j] = offset;
+            offset += count;
+          }
+          totals[j] = offset;
+        }
+      });
+      outPtr[0] = 0;
+      for (size_t j = 0; j < numMinor; j++) {
+        outPtr[j + 1] = outPtr[j] + totals[j];
+      }
+
+      // Scatter each range in order.
+      runParallel(numThreads, [&](unsigned int t) {
+        std::vector<IndexType> &cursors = counts[t];
+        std::pair<size_t, size_t> range = balancedRange(ptr, numMajor, t, numThreads);
+        for (size_t i = range.first; i < range.second; i++) {
+          for (IndexType k = ptr[i]; k < ptr[i + 1]; k++) {
+            IndexType pos = outPtr[indices[k]] + cursors[indices[k]]++;
+            outIndices[pos] = i;
+            outVals[pos] = vals[k];
+          }
+        }
+      });
+    }
+  };
+}
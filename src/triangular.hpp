@@ -0,0 +1,233 @@
+#pragma once
+
+#include "matrix.hpp"
+#include "parallel.hpp"
+#include <algorithm>
+#include <iostream>
+#include <memory>
+#include <utility>
+#include <vector>
+
+namespace thundercat {
+  // A square matrix split as A = L + D + U, with L (U) the strictly lower
+  // (upper) triangle in CSR format and D the diagonal as a dense array.
+  template<typename ValueType, typename IndexType = int>
+  struct LDU {
+    std::unique_ptr<CSRMatrix<ValueType, IndexType>> L;
+    std::vector<ValueType> D;
+    std::unique_ptr<CSRMatrix<ValueType, IndexType>> U;
+  };
+
+  enum class Triangle { LOWER, UPPER };
+
+  // The level sets of a triangular matrix: the rows of a level depend
+  // only on rows of earlier levels, so they can be solved in parallel.
+  // The rows and offsets have the index type of the matrix.
+  template<typename IndexType = int>
+  struct LevelSchedule {
+    std::vector<IndexType> levelPtr; // numLevels() + 1 offsets into rows
+    std::vector<IndexType> rows; // the rows, by level
+
+    size_t numLevels() const {
+      return levelPtr.size() - 1;
+    }
+
+    IndexType maxLevelSize() const {
+      IndexType result = 0;
+      for (size_t level = 0; level < numLevels(); level++) {
+        result = std::max(result, levelPtr[level + 1] - levelPtr[level]);
+      }
+      return result;
+    }
+
+    // The average number of rows per level.
+    double parallelism() const {
+      return numLevels() == 0 ? 0.0 : (double)rows.size() / numLevels();
+    }
+  };
+
+  class Triangular {
+  public:
+    // Splits a CSR matrix with sorted rows, e.g. the result of toCSR, into
+    // L, D and U in one pass over the elements, without going through
+    // MMMatrix::getLD/getUD. Each row is cut where its columns cross the
+    // diagonal, and the three pieces are copied as blocks; rows are split
+    // among the threads by element count. Duplicate diagonal elements are
+    // summed, and missing ones are 0 in D. Rectangular matrices are split
+    // along their main diagonal; D has min(N, M) elements.
+    // A numThreads of 0 counts as 1.
+    template<typename ValueType, typename IndexType>
+    static LDU<ValueType, IndexType> split(const CSRMatrix<ValueType, IndexType> &A, unsigned int numThreads = defaultNumThreads()) {
+      numThreads = std::max(1u, numThreads);
+      const size_t N = A.N;
+      IndexType *lowerPtr = new IndexType[N + 1];
+      IndexType *upperPtr = new IndexType[N + 1];
+      std::vector<IndexType> lowerEnds(N);
+      std::vector<IndexType> diagonalEnds(N);
+
+      // Find the cuts of each row, and count the lower and upper parts.
+      lowerPtr[0] = 0;
+      upperPtr[0] = 0;
+      runParallel(numThreads, [&](unsigned int t) {
+        std::pair<size_t, size_t> range = balancedRange(A.rowPtr, N, t, numThreads);
+        for (size_t i = range.first; i < range.second; i++) {
+          const IndexType *begin = A.colIndices + A.rowPtr[i];
+          const IndexType *end = A.colIndices + A.rowPtr[i + 1];
+          const IndexType *lowerEnd = std::lower_bound(begin, end, (IndexType)i);
+          const IndexType *diagonalEnd = std::upper_bound(lowerEnd, end, (IndexType)i);
+          lowerEnds[i] = lowerEnd - A.colIndices;
+          diagonalEnds[i] = diagonalEnd - A.colIndices;
+          lowerPtr[i + 1] = lowerEnd - begin;
+          upperPtr[i + 1] = end - diagonalEnd;
+        }
+      });
+      for (size_t i = 0; i < N; i++) {
+        lowerPtr[i + 1] += lowerPtr[i];
+        upperPtr[i + 1] += upperPtr[i];
+      }
+
+      const IndexType lowerSize = lowerPtr[N];
+      const IndexType upperSize = upperPtr[N];
+      IndexType *lowerCols = new IndexType[lowerSize];
+      ValueType *lowerVals = new ValueType[lowerSize];
+      IndexType *upperCols = new IndexType[upperSize];
+      ValueType *upperVals = new ValueType[upperSize];
+      LDU<ValueType, IndexType> result;
+      result.D.assign(std::min(A.N, A.M), ValueType(0));
+      runParallel(numThreads, [&](unsigned int t) {
+        std::pair<size_t, size_t> range = balancedRange(A.rowPtr, N, t, numThreads);
+        for (size_t i = range.first; i < range.second; i++) {
+          const IndexType begin = A.rowPtr[i];
+          const IndexType end = A.rowPtr[i + 1];
+          std::copy(A.colIndices + begin, A.colIndices + lowerEnds[i], lowerCols + lowerPtr[i]);
+          std::copy(A.values + begin, A.values + lowerEnds[i], lowerVals + lowerPtr[i]);
+          for (IndexType k = lowerEnds[i]; k < diagonalEnds[i]; k++) {
+            result.D[i] += A.values[k];
+          }
+          std::copy(A.colIndices + diagonalEnds[i], A.colIndices + end, upperCols + upperPtr[i]);
+          std::copy(A.values + diagonalEnds[i], A.values + end, upperVals + upperPtr[i]);
+        }
+      });
+
+      result.L = std::make_unique<CSRMatrix<ValueType, IndexType>>(lowerPtr, lowerCols, lowerVals, A.N, A.M, lowerSize);
+      result.U = std::make_unique<CSRMatrix<ValueType, IndexType>>(upperPtr, upperCols, upperVals, A.N, A.M, upperSize);
+      return result;
+    }
+  
+    // Computes the level sets of the rows of a square lower (upper)
+    // triangular matrix, in O(N + NZ). The level of a row is one more
+    // than the highest level of the rows it depends on. Diagonal elements
+    // may be present; elements in the other triangle are an error.
+    template<typename ValueType, typename IndexType>
+    static LevelSchedule<IndexType> analyze(const CSRMatrix<ValueType, IndexType> &A, Triangle triangle) {
+      const size_t N = A.N;
+      const bool lower = triangle == Triangle::LOWER;
+      if (A.N != A.M) {
+        std::cerr << "Triangular solves need a square matrix.\n";
+        exit(1);
+      }
+      std::vector<IndexType> levels(N);
+      IndexType numLevels = 0;
+      for (size_t step = 0; step < N; step++) {
+        const IndexType i = lower ? step : N - 1 - step;
+        IndexType level = 0;
+        for (IndexType k = A.rowPtr[i]; k < A.rowPtr[i + 1]; k++) {
+          const IndexType j = A.colIndices[k];
+          if (lower ? j > i : j < i) {
+            std::cerr << "Element (" << i << ", " << j << ") is outside the "
+                      << (lower ? "lower" : "upper") << " triangle.\n";
+            exit(1);
+          }
+          if (j != i) {
+            level = std::max(level, levels[j] + 1);
+          }
+        }
+        levels[i] = level;
+        numLevels = std::max(numLevels, level + 1);
+      }
+
+      // Bucket the rows by level; a level keeps its rows in order.
+      LevelSchedule<IndexType> schedule;
+      schedule.levelPtr.assign(numLevels + 1, 0);
+      for (IndexType level : levels) {
+        schedule.levelPtr[level + 1]++;
+      }
+      for (IndexType level = 0; level < numLevels; level++) {
+        schedule.levelPtr[level + 1] += schedule.levelPtr[level];
+      }
+      std::vector<IndexType> cursors(schedule.levelPtr.begin(), schedule.levelPtr.end() - 1);
+      schedule.rows.resize(N);
+      for (size_t i = 0; i < N; i++) {
+        schedule.rows[cursors[levels[i]]++] = i;
+      }
+      return schedule;
+    }
+
+    // Solves A x = b for a triangular A, one level of the schedule at a
+    // time; the rows of a level are split evenly among the threads. The
+    // diagonal of A is its diagonal elements plus diagonal[i] if diagonal
+    // is not null, e.g. A = L with diagonal = D from split, and it must not
+    // have zeros. x and b must not overlap.
+    template<typename ValueType, typename IndexType>
+    static void solve(const CSRMatrix<ValueType, IndexType> &A, const ValueType *diagonal,
+                      const LevelSchedule<IndexType> &schedule,
+                      const ValueType *b, ValueType *x, unsigned int numThreads = defaultNumThreads()) {
+      if (numThreads <= 1) {
+        solveRows(A, diagonal, schedule.rows.data(), schedule.rows.size(), b, x);
+        return;
+      }
+      Barrier barrier(numThreads);
+      runParallel(numThreads, [&](unsigned int t) {
+        for (size_t level = 0; level < schedule.numLevels(); level++) {
+          const IndexType begin = schedule.levelPtr[level];
+          const long size = schedule.levelPtr[level + 1] - begin;
+          const IndexType first = begin + size * t / numThreads;
+          const IndexType last = begin + size * (t + 1) / numThreads;
+          solveRows(A, diagonal, schedule.rows.data() + first, last - first, b, x);
+          barrier.wait();
+        }
+      });
+    }
+
+    // Serial forward substitution for a lower triangular A, with the
+    // diagonal as in solve.
+    template<typename ValueType, typename IndexType>
+    static void forwardSubstitution(const CSRMatrix<ValueType, IndexType> &A, const ValueType *diagonal,
+                                    const ValueType *b, ValueType *x) {
+      for (IndexType i = 0; i < (IndexType)A.N; i++) {
+        solveRows(A, diagonal, &i, 1, b, x);
+      }
+    }
+
+    // Serial backward substitution for an upper triangular A, with the
+    // diagonal as in solve.
+    template<typename ValueType, typename IndexType>
+    static void backwardSubstitution(const CSRMatrix<ValueType, IndexType> &A, const ValueType *diagonal,
+                                     const ValueType *b, ValueType *x) {
+      for (IndexType i = (IndexType)A.N - 1; i >= 0; i--) {
+        solveRows(A, diagonal, &i, 1, b, x);
+      }
+    }
+
+  private:
+    // x_i = (b_i - sum_{j != i} a_ij x_j) / a_ii for the given rows.
+    template<typename ValueType, typename IndexType>
+    static void solveRows(const CSRMatrix<ValueType, IndexType> &A, const ValueType *diagonal, const IndexType *rows,
+                          size_t numRows, const ValueType *b, ValueType *x) {
+      for (size_t r = 0; r < numRows; r++) {
+        const IndexType i = rows[r];
+        ValueType sum = b[i];
+        ValueType pivot = diagonal ? diagonal[i] : ValueType(0);
+        for (IndexType k = A.rowPtr[i]; k < A.rowPtr[i + 1]; k++) {
+          const IndexType j = A.colIndices[k];
+          if (j == i) {
+            pivot += A.values[k];
+          } else {
+            sum -= A.values[k] * x[j];
+          }
+        }
+        x[i] = sum / pivot;
+      }
+    }
+  };
+}
@@ -0,0 +1,56 @@
+#pragma once
+
+#include <complex>
+
+namespace thundercat {
+  // The symmetry classes of Matrix Market files. For all but GENERAL,
+  // only one triangle is stored, and element (j, i) is derived from
+  // element (i, j): as is, negated, or conjugated, respectively.
+  enum class Symmetry { GENERAL = 0, SYMMETRIC = 1, SKEW_SYMMETRIC = 2, HERMITIAN = 3 };
+
+  template<typename ValueType>
+  struct ValueTraits {
+    static const bool isComplex = false;
+
+    // The imaginary part of real-valued files is always 0.
+    static ValueType make(double real, double) {
+      return (ValueType)real;
+    }
+
+    static ValueType conj(ValueType val) {
+      return val;
+    }
+
+    static ValueType max(ValueType a, ValueType b) {
+      return a < b ? b : a;
+    }
+  };
+
+  template<typename T>
+  struct ValueTraits< std::complex<T> > {
+    static const bool isComplex = true;
+
+    static std::complex<T> make(double real, double imag) {
+      return std::complex<T>((T)real, (T)imag);
+    }
+
+    static std::complex<T> conj(std::complex<T> val) {
+      return std::conj(val);
+    }
+
+    // Complex values are ordered by magnitude.
+    static std::complex<T> max(std::complex<T> a, std::complex<T> b) {
+      return std::abs(a) < std::abs(b) ? b : a;
+    }
+  };
+
+  // The value of element (j, i), given the value of element (i, j).
+  template<typename ValueType>
+  ValueType mirrorValue(Symmetry symmetry, ValueType val) {
+    switch (symmetry) {
+      case Symmetry::SKEW_SYMMETRIC: return -val;
+      case Symmetry::HERMITIAN: return ValueTraits<ValueType>::conj(val);
+      default: return val;
+    }
+  }
+}